@@ -0,0 +1,182 @@
+#include "BMPFormat.h"
+#include "PixelKernels.h"
+#include "Rle.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const uint32_t kRgb = 0; // BI_RGB
+const uint32_t kRle8 = 1; // BI_RLE8
+const uint32_t kRle4 = 2; // BI_RLE4
+const uint32_t kBitFields = 3; // BI_BITFIELDS
+const uint32_t kAlphaBitFields = 6; // BI_ALPHABITFIELDS
+
+const size_t kInfoHeaderSize = 40;
+const size_t kV5HeaderSize = 124;
+const size_t kColorSpaceOffset = 56; // offsets inside the DIB header
+const size_t kProfileDataOffset = 112;
+
+const uint32_t kSRGB = 0x73524742; // 'sRGB'
+const uint32_t kLinkedProfile = 0x4C494E4B; // 'LINK'
+const uint32_t kEmbeddedProfile = 0x4D424544; // 'MBED'
+
+size_t MasksSize(const BMPHeaders &headers) { // bit masks stored after a BITMAPINFOHEADER
+    if (headers.DIBHeader_size != kInfoHeaderSize) {
+        return 0;
+    }
+    if (headers.compression_method == kBitFields) {
+        return 3 * sizeof(uint32_t);
+    }
+    return headers.compression_method == kAlphaBitFields ? 4 * sizeof(uint32_t) : 0;
+}
+
+size_t PaletteSize(const BMPHeaders &headers) {
+    if (headers.bits_per_pixel > 8) {
+        return 0;
+    }
+    return headers.colors_number == 0 ? size_t{1} << headers.bits_per_pixel : headers.colors_number;
+}
+
+uint32_t LoadWord(const uint8_t *bytes) {
+    uint32_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+void StoreWord(uint8_t *bytes, uint32_t word) {
+    std::memcpy(bytes, &word, sizeof(word));
+}
+
+}
+
+BMPFormat::BMPFormat() : bits_per_pixel_(24), compression_(kRgb), colors_(), gray_(false) {}
+
+BMPFormat::BMPFormat(const BMPHeaders &headers, const uint8_t *extra, size_t size)
+        : bits_per_pixel_(headers.bits_per_pixel), compression_(headers.compression_method), colors_(),
+          gray_(false) {
+    if (size < ExtraSize(headers)) {
+        throw std::runtime_error("Unexpected end of file while reading the headers\n");
+    }
+    size_t extension = headers.DIBHeader_size - kInfoHeaderSize + MasksSize(headers);
+    header_extension_.assign(extra, extra + extension);
+
+    if (compression_ == kBitFields || compression_ == kAlphaBitFields) { // the masks must describe B, G, R, A bytes
+        const uint8_t *masks = header_extension_.data(); // in a V4/V5 header or right after a short one
+        if (LoadWord(masks) != 0x00FF0000 || LoadWord(masks + 4) != 0x0000FF00 || LoadWord(masks + 8) != 0x000000FF) {
+            throw std::runtime_error("32-bit images must keep their channels in B, G, R, A order\n");
+        }
+    }
+    if (headers.DIBHeader_size == kV5HeaderSize) { // profiles live after the pixels and are not copied
+        uint32_t color_space = LoadWord(header_extension_.data() + kColorSpaceOffset - kInfoHeaderSize);
+        if (color_space == kLinkedProfile || color_space == kEmbeddedProfile) {
+            StoreWord(header_extension_.data() + kColorSpaceOffset - kInfoHeaderSize, kSRGB);
+            StoreWord(header_extension_.data() + kProfileDataOffset - kInfoHeaderSize, 0);
+            StoreWord(header_extension_.data() + kProfileDataOffset + 4 - kInfoHeaderSize, 0);
+        }
+    }
+
+    const uint8_t *palette = extra + extension;
+    palette_.resize(PaletteSize(headers));
+    gray_ = bits_per_pixel_ <= 8;
+    for (size_t index = 0; index < palette_.size(); ++index) { // palette entries are B, G, R and a zero
+        palette_[index] = Pixel{palette[4 * index], palette[4 * index + 1], palette[4 * index + 2]};
+        gray_ = gray_ && palette[4 * index] == palette[4 * index + 1] && palette[4 * index] == palette[4 * index + 2];
+    }
+    std::copy(palette_.begin(), palette_.begin() + std::min(palette_.size(), colors_.size()), colors_.begin());
+}
+
+size_t BMPFormat::ExtraSize(const BMPHeaders &headers) {
+    return headers.DIBHeader_size - kInfoHeaderSize + MasksSize(headers) + 4 * PaletteSize(headers);
+}
+
+uint16_t BMPFormat::BitsPerPixel() const {
+    return bits_per_pixel_;
+}
+
+size_t BMPFormat::Stride(size_t width) const {
+    return (width * bits_per_pixel_ + 31) / 32 * 4;
+}
+
+bool BMPFormat::IsCompressed() const {
+    return compression_ == kRle8 || compression_ == kRle4;
+}
+
+bool BMPFormat::HasAlpha() const {
+    return bits_per_pixel_ == 32;
+}
+
+bool BMPFormat::IsGray() const {
+    return gray_;
+}
+
+BMPFormat BMPFormat::Output(Compression compression) const {
+    BMPFormat output = *this;
+    if (bits_per_pixel_ <= 8 && !gray_) {
+        output.bits_per_pixel_ = 24;
+        output.compression_ = kRgb;
+        output.palette_.clear();
+    } else if (gray_) { // filters may make any gray, so the palette gets all of them
+        output.bits_per_pixel_ = 8;
+        output.compression_ = compression == Compression::Rle8 ? kRle8 : kRgb;
+        output.palette_.resize(256);
+        for (size_t index = 0; index < output.palette_.size(); ++index) {
+            output.palette_[index] = Pixel{static_cast<uint8_t>(index), static_cast<uint8_t>(index),
+                                           static_cast<uint8_t>(index)};
+        }
+        output.colors_.fill(Pixel{});
+        std::copy(output.palette_.begin(), output.palette_.end(), output.colors_.begin());
+    }
+    return output;
+}
+
+void BMPFormat::Apply(BMPHeaders &headers) const {
+    headers.bits_per_pixel = bits_per_pixel_;
+    headers.compression_method = compression_;
+    headers.colors_number = palette_.size();
+    headers.important_colors_number = 0;
+    headers.offset = sizeof(BMPHeaders) + header_extension_.size() + 4 * palette_.size();
+}
+
+std::vector<uint8_t> BMPFormat::Extra() const {
+    std::vector<uint8_t> extra = header_extension_;
+    for (const Pixel &color: palette_) {
+        extra.insert(extra.end(), {color.red, color.green, color.blue, 0});
+    }
+    return extra;
+}
+
+void BMPFormat::IndexedRow(const uint8_t *indices, size_t width, Pixel *row) const {
+    ExpandIndices(indices, width, colors_.data(), row);
+}
+
+size_t BMPFormat::MaxRowSize(size_t width) const {
+    return compression_ == kRle8 ? MaxRle8Row(width) : width * bits_per_pixel_ / 8;
+}
+
+void BMPFormat::DecodeRow(const uint8_t *source, size_t width, Pixel *row, uint8_t *alpha) const {
+    if (bits_per_pixel_ == 8) {
+        ExpandIndices(source, width, colors_.data(), row);
+    } else if (bits_per_pixel_ == 32) {
+        UnpackBGRA(source, width, row, alpha);
+    } else {
+        std::memcpy(row, source, width * sizeof(Pixel));
+    }
+}
+
+size_t BMPFormat::EncodeRow(const Pixel *row, const uint8_t *alpha, size_t width, uint8_t *target) const {
+    if (compression_ == kRle8) {
+        return EncodeRle8Row(&row[0].green, width, sizeof(Pixel), target);
+    }
+    if (bits_per_pixel_ == 8) {
+        for (size_t i = 0; i < width; ++i) {
+            target[i] = row[i].green;
+        }
+    } else if (bits_per_pixel_ == 32) {
+        PackBGRA(row, alpha, width, target);
+    } else {
+        std::memcpy(target, row, width * sizeof(Pixel));
+    }
+    return width * bits_per_pixel_ / 8;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "BMPstruct.h"
+#include <array>
+#include <cstddef>
+#include <vector>
+
+enum class Compression {
+    None, // pixels are written as they are
+    Rle8, // images written with 8 bits per pixel are run-length encoded, the others are written as they are
+};
+
+// How the pixels of a BMP file are stored: 8 bits per pixel with a palette (possibly run-length encoded, as are
+// 4 bits per pixel), 24 bits or 32 bits with an alpha (or reserved) byte, and everything the file has between its
+// BMPHeaders and the pixels: the rest of a V4/V5 header, bit masks and the palette. Filters always see 24-bit
+// pixels, rows are converted on the way in and out.
+class BMPFormat {
+public:
+    BMPFormat(); // 24 bits per pixel with a BITMAPINFOHEADER
+
+    // extra holds the ExtraSize(headers) bytes that follow the headers in the file
+    BMPFormat(const BMPHeaders &headers, const uint8_t *extra, size_t size);
+
+    static size_t ExtraSize(const BMPHeaders &headers); // the headers must have passed CheckHeaders
+
+    uint16_t BitsPerPixel() const;
+
+    size_t Stride(size_t width) const; // bytes of a padded row in the file, if it isn't compressed
+
+    bool IsCompressed() const; // BI_RLE8 or BI_RLE4, rows have to be decoded one after another (see Rle.h)
+
+    bool HasAlpha() const; // 32 bits per pixel, the fourth byte is kept whatever it means
+
+    bool IsGray() const; // a palette of grays only
+
+    // the format filtered images are written in: the same one, except that images with a palette become 8-bit
+    // ones with all 256 grays if the palette has grays only and 24-bit ones otherwise, as filters may give them
+    // colors the palette doesn't have; the compression is the one asked for, if the format can have it
+    BMPFormat Output(Compression compression = Compression::None) const;
+
+    // sets bits per pixel, compression, number of colors and the pixel offset of headers of an image in this format
+    void Apply(BMPHeaders &headers) const;
+
+    // the bytes written between the headers and the pixels: the header extension, masks and the palette
+    std::vector<uint8_t> Extra() const;
+
+    // alpha may be null, then it is dropped on decoding and 255 on encoding; rows of compressed formats are
+    // decoded by an RleDecoder into indices for IndexedRow
+    void DecodeRow(const uint8_t *source, size_t width, Pixel *row, uint8_t *alpha) const;
+
+    void IndexedRow(const uint8_t *indices, size_t width, Pixel *row) const; // the colors of palette indices
+
+    size_t MaxRowSize(size_t width) const; // bytes EncodeRow may take
+
+    // 8-bit rows are written as grays only (see Output), all three channels of a gray are equal;
+    // returns the number of bytes written without the padding of uncompressed rows
+    size_t EncodeRow(const Pixel *row, const uint8_t *alpha, size_t width, uint8_t *target) const;
+
+private:
+    uint16_t bits_per_pixel_;
+    uint32_t compression_;
+    std::vector<uint8_t> header_extension_; // the V4/V5 part of the DIB header or the bit masks after a short one
+    std::vector<Pixel> palette_;
+    std::array<Pixel, 256> colors_; // the palette, indices beyond it are black
+    bool gray_;
+};
@@ -0,0 +1,193 @@
+#include "BMPReader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+void CheckHeaders(const BMPHeaders &headers) {
+    if (headers.file_type != 0x4D42) {
+        throw std::runtime_error("The only supported file format is BMP\n");
+    }
+
+    if (headers.DIBHeader_size != 40 && headers.DIBHeader_size != 108 && headers.DIBHeader_size != 124) {
+        throw std::runtime_error("DIB header must be a BITMAPINFOHEADER, BITMAPV4HEADER or BITMAPV5HEADER\n");
+    }
+
+    uint16_t bits = headers.bits_per_pixel;
+    uint32_t compression = headers.compression_method;
+    if (bits != 4 && bits != 8 && bits != 24 && bits != 32) {
+        throw std::runtime_error("The number of bits per pixel has to be 4, 8, 24 or 32\n");
+    }
+    if (bits == 4 && compression != 2) {
+        throw std::runtime_error("4-bit images must be RLE4 compressed\n");
+    }
+
+    bool supported = compression == 0 || (bits == 32 && (compression == 3 || compression == 6)) ||
+                     (bits == 8 && compression == 1) || (bits == 4 && compression == 2);
+    if (!supported) {
+        throw std::runtime_error("Only RLE8, RLE4 and BGRA bit fields compressions are supported\n");
+    }
+
+    if (bits <= 8 && headers.colors_number > (1u << bits)) {
+        throw std::runtime_error("A palette can't have more colors than the bits per pixel allow\n");
+    }
+
+    if (headers.height_ == std::numeric_limits<int32_t>::min()) { // a top-down height that has no positive value
+        throw std::runtime_error("The height of the image is out of range\n");
+    }
+
+    if (headers.height_ < 0 && (compression == 1 || compression == 2)) {
+        throw std::runtime_error("Compressed images can't be top-down\n");
+    }
+}
+
+RowOrder TakeRowOrder(BMPHeaders &headers) {
+    if (headers.height_ >= 0) {
+        return RowOrder::BottomUp;
+    }
+    headers.height_ = -headers.height_;
+    return RowOrder::TopDown;
+}
+
+BMPFormat ReadFormat(const BMPHeaders &headers, const uint8_t *file, size_t size) {
+    size_t extra = BMPFormat::ExtraSize(headers);
+    if (size < sizeof(BMPHeaders) + extra || headers.offset < sizeof(BMPHeaders) + extra) {
+        throw std::runtime_error("Unexpected end of file while reading the headers\n");
+    }
+    return BMPFormat(headers, file + sizeof(BMPHeaders), extra);
+}
+
+BMPReader::BMPReader(const std::string &file_name) : fd_(open(file_name.c_str(), O_RDONLY)) {
+    if (fd_ == -1) {
+        throw std::runtime_error("Cannot open input file\n");
+    }
+    if (pread(fd_, &headers_, sizeof(headers_), 0) != sizeof(headers_)) {
+        close(fd_);
+        throw std::runtime_error("The only supported file format is BMP\n");
+    }
+    try {
+        CheckHeaders(headers_);
+        order_ = TakeRowOrder(headers_);
+        std::vector<uint8_t> extra(BMPFormat::ExtraSize(headers_));
+        if (pread(fd_, extra.data(), extra.size(), sizeof(headers_)) != static_cast<ssize_t>(extra.size()) ||
+            headers_.offset < sizeof(headers_) + extra.size()) {
+            throw std::runtime_error("Unexpected end of file while reading the headers\n");
+        }
+        format_ = BMPFormat(headers_, extra.data(), extra.size());
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+    stride_ = format_.Stride(headers_.width_);
+}
+
+BMPReader::~BMPReader() {
+    close(fd_);
+}
+
+const BMPHeaders &BMPReader::Headers() const {
+    return headers_;
+}
+
+const BMPFormat &BMPReader::Format() const {
+    return format_;
+}
+
+RowOrder BMPReader::Order() const {
+    return order_;
+}
+
+void BMPReader::ReadRows(size_t first_row, size_t count, ImageBuffer &target, size_t target_row,
+                         PlanarBuffer *alpha) const {
+    if (format_.IsCompressed()) {
+        ReadCompressedRows(first_row, count, target, target_row);
+        return;
+    }
+    if (stride_ == 0) { // an image 0 pixels wide, its rows take no bytes
+        return;
+    }
+    bool top_down = order_ == RowOrder::TopDown;
+    // rows of other formats are read in chunks and decoded, top-down ones are put in reverse on the way
+    if (format_.BitsPerPixel() != 24 || top_down) {
+        size_t height = headers_.height_;
+        size_t chunk_rows = std::max<size_t>(1, kDecodeChunk / stride_);
+        std::vector<uint8_t> chunk(std::min(count, chunk_rows) * stride_);
+        for (size_t begin = 0; begin < count; begin += chunk_rows) {
+            size_t rows = std::min(chunk_rows, count - begin);
+            size_t file_row = top_down ? height - (first_row + begin + rows) : first_row + begin;
+            ReadBytes(chunk.data(), rows * stride_, headers_.offset + file_row * stride_);
+            for (size_t i = 0; i < rows; ++i) {
+                size_t row = target_row + begin + (top_down ? rows - 1 - i : i);
+                format_.DecodeRow(chunk.data() + i * stride_, headers_.width_, target.Row(row),
+                                  alpha && !alpha->Empty() ? alpha->Row(0, row) : nullptr);
+            }
+        }
+        return;
+    }
+    if (target.Stride() == stride_) { // the rows are contiguous both in the file and in the buffer
+        ReadBytes(reinterpret_cast<uint8_t *>(target.Row(target_row)), count * stride_,
+                  headers_.offset + first_row * stride_);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = headers_.width_ * sizeof(Pixel);
+        size_t offset = headers_.offset + (first_row + i) * stride_;
+        if (pread(fd_, target.Row(target_row + i), length, static_cast<off_t>(offset)) !=
+            static_cast<ssize_t>(length)) {
+            throw std::runtime_error("Unexpected end of file while reading pixels\n");
+        }
+    }
+}
+
+void BMPReader::ReadBytes(uint8_t *destination, size_t length, size_t offset) const {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t result = pread(fd_, destination + done, length - done, static_cast<off_t>(offset + done));
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            throw std::runtime_error("Unexpected end of file while reading pixels\n");
+        }
+        done += result;
+    }
+}
+
+void BMPReader::ReadCompressedRows(size_t first_row, size_t count, ImageBuffer &target, size_t target_row) const {
+    if (!rle_ || rle_->next_row > first_row) { // rows are decoded in order, going back means starting over
+        rle_.emplace(RleStream{RleDecoder(format_.BitsPerPixel(), headers_.width_), 0, headers_.offset,
+                               std::vector<uint8_t>(kDecodeChunk), 0, 0});
+    }
+    RleStream &rle = *rle_;
+    std::vector<uint8_t> indices(headers_.width_);
+    while (rle.next_row < first_row + count) {
+        std::optional<size_t> used;
+        while (!(used = rle.decoder.DecodeRow(rle.bytes.data() + rle.begin, rle.end - rle.begin, indices.data()))) {
+            std::memmove(rle.bytes.data(), rle.bytes.data() + rle.begin, rle.end - rle.begin);
+            rle.end -= rle.begin;
+            rle.begin = 0;
+            if (rle.end == rle.bytes.size()) { // a row longer than the buffer
+                rle.bytes.resize(2 * rle.bytes.size());
+            }
+            ssize_t result = pread(fd_, rle.bytes.data() + rle.end, rle.bytes.size() - rle.end,
+                                   static_cast<off_t>(rle.file_offset));
+            if (result == -1 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                throw std::runtime_error("Unexpected end of file while reading pixels\n");
+            }
+            rle.end += result;
+            rle.file_offset += result;
+        }
+        rle.begin += *used;
+        if (rle.next_row >= first_row) {
+            format_.IndexedRow(indices.data(), headers_.width_, target.Row(target_row + rle.next_row - first_row));
+        }
+        ++rle.next_row;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "BMPFormat.h"
+#include "ImageBuffer.h"
+#include "PlanarBuffer.h"
+#include "Rle.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+void CheckHeaders(const BMPHeaders &headers);
+
+// rows of top-down files (negative height) are numbered bottom-up as well: makes the height positive and returns
+// the order of the rows in the file
+RowOrder TakeRowOrder(BMPHeaders &headers);
+
+// the format of a file that starts with headers, file holds its first size bytes
+BMPFormat ReadFormat(const BMPHeaders &headers, const uint8_t *file, size_t size);
+
+// Reads rows of a BMP file on demand, so the whole image never has to be in memory. Compressed files are decoded
+// as the rows are asked for, which is fast when they are asked for in order (as BandPipeline does).
+class BMPReader {
+public:
+    static constexpr size_t kDecodeChunk = 1 << 20; // bytes of rows read at once before they are decoded
+
+    BMPReader(const std::string &file_name);
+
+    BMPReader(const BMPReader &other) = delete;
+
+    BMPReader &operator=(const BMPReader &other) = delete;
+
+    ~BMPReader();
+
+    const BMPHeaders &Headers() const;
+
+    const BMPFormat &Format() const;
+
+    RowOrder Order() const; // of the rows in the file, Headers() have the positive height either way
+
+    // reads rows [first_row, first_row + count), counted from the bottom of the image, into target rows starting
+    // from target_row, decoded into 24-bit pixels; alpha bytes of 32-bit files go to the same rows of alpha if it is
+    // given
+    void ReadRows(size_t first_row, size_t count, ImageBuffer &target, size_t target_row,
+                  PlanarBuffer *alpha = nullptr) const;
+
+private:
+    struct RleStream { // how far decoding of a compressed file has got
+        RleDecoder decoder;
+        size_t next_row;
+        size_t file_offset; // of the first byte that isn't in bytes yet
+        std::vector<uint8_t> bytes;
+        size_t begin; // bytes [begin, end) are read, but not decoded yet
+        size_t end;
+    };
+
+    void ReadBytes(uint8_t *destination, size_t length, size_t offset) const;
+
+    void ReadCompressedRows(size_t first_row, size_t count, ImageBuffer &target, size_t target_row) const;
+
+    int fd_;
+    BMPHeaders headers_;
+    BMPFormat format_;
+    RowOrder order_;
+    size_t stride_;
+    mutable std::optional<RleStream> rle_;
+};
@@ -0,0 +1,192 @@
+#include "BMPWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <unistd.h>
+
+void BMPWriter::AlignedDeleter::operator()(uint8_t *ptr) const {
+    ::operator delete[](ptr, std::align_val_t{kDirectAlignment});
+}
+
+BMPWriter::BMPWriter(const std::string &file_name, const BMPHeaders &headers, WriteMode mode)
+        : BMPWriter(file_name, headers, BMPFormat(), mode) {}
+
+BMPWriter::BMPWriter(const std::string &file_name, const BMPHeaders &headers, const BMPFormat &format,
+                     WriteMode mode) : format_(format), fd_(-1), direct_(false), drop_cache_(false), file_offset_(0),
+                                       cached_offset_(0), staged_(0) {
+    // sizes of compressed files are known only at the end, so their headers are written again then, and this
+    // small unaligned write doesn't go with O_DIRECT
+    if (mode == WriteMode::Direct && !format_.IsCompressed()) {
+        fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        direct_ = fd_ != -1;
+    }
+    if (fd_ == -1) { // O_DIRECT is not supported everywhere (e.g. tmpfs), fall back to the page cache
+        fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        drop_cache_ = mode == WriteMode::Direct;
+    }
+    if (fd_ == -1) {
+        throw std::runtime_error("Cannot open output file");
+    }
+
+    staging_.reset(static_cast<uint8_t *>(::operator new[](kBlockSize * kBlockCount,
+                                                           std::align_val_t{kDirectAlignment})));
+
+    width_ = headers.width_;
+    rows_left_ = headers.height_;
+    row_length_ = width_ * format_.BitsPerPixel() / 8;
+    padding_amount_ = format_.IsCompressed() ? 0 : (4 - row_length_ % 4) % 4;
+    if (format_.BitsPerPixel() != 24) {
+        encoded_.resize(format_.MaxRowSize(width_));
+    }
+
+    BMPHeaders fixed_headers = headers;
+    format_.Apply(fixed_headers);
+    fixed_headers.image_size = (row_length_ + padding_amount_) * headers.height_;
+    fixed_headers.file_size = fixed_headers.offset + fixed_headers.image_size;
+    file_size_ = fixed_headers.file_size;
+    pixels_offset_ = fixed_headers.offset;
+
+    std::memcpy(staging_.get(), &fixed_headers, sizeof(fixed_headers));
+    staged_ = sizeof(fixed_headers);
+    std::vector<uint8_t> extra = format_.Extra(); // the rest of the header and the palette, a few kilobytes at most
+    std::copy(extra.begin(), extra.end(), staging_.get() + staged_); // none for plain 24-bit files
+    staged_ += extra.size();
+}
+
+BMPWriter::~BMPWriter() {
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+void BMPWriter::WriteRow(const Pixel *row, const uint8_t *alpha) {
+    if (encoded_.empty()) {
+        Stage(reinterpret_cast<const uint8_t *>(row), row_length_);
+    } else {
+        Stage(encoded_.data(), format_.EncodeRow(row, alpha, width_, encoded_.data()));
+    }
+    rows_left_ -= rows_left_ > 0 ? 1 : 0;
+    for (size_t i = 0; i < padding_amount_; ++i) {
+        if (staged_ == kBlockSize * kBlockCount) {
+            Flush(false);
+        }
+        staging_[staged_++] = 0;
+    }
+}
+
+void BMPWriter::WriteRows(const ImageBuffer &buffer, const PlanarBuffer *alpha) {
+    for (size_t i = 0; i < buffer.Height(); ++i) {
+        WriteRow(buffer.Row(i), alpha && !alpha->Empty() ? alpha->Row(0, i) : nullptr);
+    }
+}
+
+void BMPWriter::Stage(const uint8_t *bytes, size_t length) {
+    const uint8_t *source = bytes;
+    size_t left = length;
+    while (left > 0) { // a row may be split between two flushes
+        if (staged_ == kBlockSize * kBlockCount) {
+            Flush(false);
+        }
+        size_t chunk = std::min(left, kBlockSize * kBlockCount - staged_);
+        std::memcpy(staging_.get() + staged_, source, chunk);
+        staged_ += chunk;
+        source += chunk;
+        left -= chunk;
+    }
+}
+
+void BMPWriter::Flush(bool last) {
+    size_t length = staged_;
+    if (direct_ && last) { // direct writes must cover whole blocks, the tail is cut off by ftruncate below
+        length = (length + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+        std::memset(staging_.get() + staged_, 0, length - staged_);
+    }
+
+    iovec blocks[kBlockCount];
+    size_t blocks_number = 0;
+    for (size_t begin = 0; begin < length; begin += kBlockSize) {
+        blocks[blocks_number].iov_base = staging_.get() + begin;
+        blocks[blocks_number].iov_len = std::min(kBlockSize, length - begin);
+        ++blocks_number;
+    }
+
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = pwritev(fd_, blocks, static_cast<int>(blocks_number), file_offset_ + written);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Cannot write to output file");
+        }
+        written += result;
+        // skip fully written blocks and shift the partially written one
+        size_t skipped = 0;
+        size_t done = result;
+        while (skipped < blocks_number && done >= blocks[skipped].iov_len) {
+            done -= blocks[skipped].iov_len;
+            ++skipped;
+        }
+        if (skipped < blocks_number) {
+            blocks[skipped].iov_base = static_cast<uint8_t *>(blocks[skipped].iov_base) + done;
+            blocks[skipped].iov_len -= done;
+        }
+        std::copy(blocks + skipped, blocks + blocks_number, blocks);
+        blocks_number -= skipped;
+    }
+
+    if (drop_cache_) { // start writeback of this range and evict the previous one once it is on disk
+        sync_file_range(fd_, static_cast<off_t>(file_offset_), static_cast<off_t>(staged_), SYNC_FILE_RANGE_WRITE);
+        if (file_offset_ != cached_offset_) { // earlier ranges are evicted already, each flush waits for one range
+            auto previous = static_cast<off_t>(file_offset_ - cached_offset_);
+            sync_file_range(fd_, static_cast<off_t>(cached_offset_), previous,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd_, static_cast<off_t>(cached_offset_), previous, POSIX_FADV_DONTNEED);
+            cached_offset_ = file_offset_;
+        }
+    }
+    file_offset_ += staged_;
+    staged_ = 0;
+}
+
+void BMPWriter::Close() {
+    if (fd_ == -1) {
+        return;
+    }
+    if (format_.IsCompressed()) {
+        if (rows_left_ != 0) {
+            throw std::runtime_error("Wrong number of rows written to output file");
+        }
+        const uint8_t end_of_image[] = {0, 1};
+        Stage(end_of_image, sizeof(end_of_image));
+        Flush(true);
+        WriteSizes();
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    Flush(true);
+    if (file_offset_ != file_size_) {
+        throw std::runtime_error("Wrong number of rows written to output file");
+    }
+    if (direct_ && ftruncate(fd_, static_cast<off_t>(file_size_)) == -1) {
+        throw std::runtime_error("Cannot write to output file");
+    }
+    close(fd_);
+    fd_ = -1;
+}
+
+void BMPWriter::WriteSizes() {
+    uint32_t file_size = file_offset_;
+    uint32_t image_size = file_offset_ - pixels_offset_;
+    if (pwrite(fd_, &file_size, sizeof(file_size), offsetof(BitmapFileHeader, file_size)) != sizeof(file_size) ||
+        pwrite(fd_, &image_size, sizeof(image_size), sizeof(BitmapFileHeader) + offsetof(DIBHeader, image_size)) !=
+        sizeof(image_size)) {
+        throw std::runtime_error("Cannot write to output file");
+    }
+}
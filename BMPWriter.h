@@ -0,0 +1,64 @@
+#pragma once
+
+#include "BMPFormat.h"
+#include "ImageBuffer.h"
+#include "PlanarBuffer.h"
+#include <string>
+#include <vector>
+
+enum class WriteMode {
+    Buffered, // regular writes through the page cache
+    Direct, // O_DIRECT writes that bypass the page cache where the file system supports it
+};
+
+class BMPWriter { // collects padded rows in large aligned staging blocks and flushes them with pwritev
+public:
+    static constexpr size_t kBlockSize = 1 << 20;
+    static constexpr size_t kBlockCount = 8;
+    static constexpr size_t kDirectAlignment = 4096;
+
+    // file_size, image_size and offset of the headers are recalculated from width, height and the format
+    BMPWriter(const std::string &file_name, const BMPHeaders &headers, WriteMode mode = WriteMode::Buffered);
+
+    BMPWriter(const std::string &file_name, const BMPHeaders &headers, const BMPFormat &format,
+              WriteMode mode = WriteMode::Buffered);
+
+    BMPWriter(const BMPWriter &other) = delete;
+
+    BMPWriter &operator=(const BMPWriter &other) = delete;
+
+    ~BMPWriter();
+
+    void WriteRow(const Pixel *row, const uint8_t *alpha = nullptr); // alpha is used by 32-bit formats only
+
+    void WriteRows(const ImageBuffer &buffer, const PlanarBuffer *alpha = nullptr);
+
+    void Close();
+
+private:
+    void Stage(const uint8_t *bytes, size_t length);
+
+    void Flush(bool last);
+
+    void WriteSizes(); // file and image size of a compressed file, once all of it is written
+
+    struct AlignedDeleter {
+        void operator()(uint8_t *ptr) const;
+    };
+
+    BMPFormat format_;
+    std::vector<uint8_t> encoded_; // a row of a format other than 24-bit
+    int fd_;
+    bool direct_;
+    bool drop_cache_; // direct mode requested, but emulated with writeback hints
+    size_t width_;
+    size_t rows_left_;
+    size_t row_length_;
+    size_t padding_amount_;
+    size_t file_size_;
+    size_t pixels_offset_;
+    size_t file_offset_; // where the staged bytes go
+    size_t cached_offset_; // the bytes before it are evicted from the page cache in drop-cache mode
+    size_t staged_;
+    std::unique_ptr<uint8_t[], AlignedDeleter> staging_;
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <inttypes.h>
 
 #pragma pack(push, 1)
@@ -13,7 +15,7 @@ struct BitmapFileHeader {
 struct DIBHeader {
     uint32_t DIBHeader_size;
     uint32_t width_;
-    uint32_t height_;
+    int32_t height_; // negative for top-down files
     uint16_t color_planes;
     uint16_t bits_per_pixel;
     uint32_t compression_method;
@@ -0,0 +1,163 @@
+#include "BandPipeline.h"
+#include "FilterFactory.h"
+#include "Profiler.h"
+#include "ScratchArena.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+BandPipeline::BandPipeline(std::vector<std::shared_ptr<Filter>> filters, size_t band_height)
+        : filters_(std::move(filters)), band_height_(std::max<size_t>(band_height, 1)) {
+    if (!CanStream(filters_)) {
+        throw std::runtime_error("The filter chain can only be applied to the whole image\n");
+    }
+}
+
+bool BandPipeline::CanStream(const std::vector<std::shared_ptr<Filter>> &filters) {
+    return std::all_of(filters.begin(), filters.end(), [](const auto &filter) {
+        return filter->Halo() != Filter::kWholeImage;
+    });
+}
+
+size_t BandPipeline::Halo() const {
+    size_t halo = 0; // every filter works on the output of the previous one, so their halos add up
+    for (const auto &filter: filters_) {
+        halo += filter->Halo();
+    }
+    return halo;
+}
+
+size_t BandPipeline::Run(const std::string &input_file, const std::string &output_file, WriteMode mode,
+                         Compression compression) const {
+    BMPReader reader(input_file);
+    const BMPHeaders &headers = reader.Headers();
+    BMPWriter writer(output_file, headers, reader.Format().Output(compression), mode);
+
+    SpscQueue<Band> bands(kQueueDepth);
+    SpscQueue<Band> filtered(kQueueDepth);
+    std::exception_ptr read_error;
+    std::exception_ptr filter_error;
+    std::exception_ptr write_error;
+
+    // a stage that fails closes both of its queues, so the stages before and after it stop too
+    std::thread read_thread([this, &reader, &input_file, &bands, &read_error]() {
+        try {
+            ReadBands(reader, input_file, bands);
+        } catch (...) {
+            read_error = std::current_exception();
+        }
+        bands.Close();
+    });
+    std::thread write_thread([&writer, &output_file, &filtered, &bands, &write_error]() {
+        try {
+            WriteBands(writer, output_file, filtered);
+        } catch (...) {
+            write_error = std::current_exception();
+            bands.Close();
+        }
+        filtered.Close();
+    });
+    try {
+        FilterBands(headers, bands, filtered);
+    } catch (...) {
+        filter_error = std::current_exception();
+    }
+    bands.Close();
+    filtered.Close();
+    read_thread.join();
+    write_thread.join();
+
+    for (const auto &error: {read_error, filter_error, write_error}) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    writer.Close();
+    return static_cast<size_t>(headers.height_) * static_cast<size_t>(headers.width_);
+}
+
+void BandPipeline::ReadBands(const BMPReader &reader, const std::string &input_file, SpscQueue<Band> &bands) const {
+    const BMPHeaders &headers = reader.Headers();
+    size_t height = headers.height_;
+    size_t width = headers.width_;
+    size_t halo = Halo();
+
+    // a band is never shorter than 2 * halo + 1 rows, so a filter never sees fewer rows than its own window
+    size_t min_rows = std::min(height, 2 * halo + 1);
+    size_t window_rows = std::min(height, std::max(band_height_ + 2 * halo, min_rows));
+    ScratchArena &arena = ScratchArena::Instance();
+    // unfiltered rows [window_first, window_first + window_count)
+    ImageBuffer window = arena.Acquire(window_rows, width);
+    PlanarBuffer window_alpha = reader.Format().HasAlpha() ? PlanarBuffer(window_rows, width, 1) : PlanarBuffer();
+    size_t window_first = 0;
+    size_t window_count = 0;
+
+    for (size_t begin = 0; begin < height; begin += band_height_) {
+        size_t end = std::min(height, begin + band_height_);
+
+        size_t low = begin > halo ? begin - halo : 0;
+        size_t high = std::min(height, end + halo);
+        if (high - low < min_rows) {
+            low = high > min_rows ? high - min_rows : 0;
+            high = low + min_rows;
+        }
+
+        // rows shared with the previous band are moved to the top of the window, the rest is read from the file
+        size_t kept = 0;
+        if (low >= window_first && low < window_first + window_count) {
+            kept = window_first + window_count - low;
+            std::memmove(window.Data(), window.Data() + (low - window_first) * window.Stride(),
+                         kept * window.Stride());
+            for (size_t i = 0; i < kept && !window_alpha.Empty(); ++i) {
+                std::memcpy(window_alpha.Row(0, i), window_alpha.Row(0, low - window_first + i), width);
+            }
+        }
+        {
+            ProfileScope scope("read", input_file, (high - low - kept) * window.Stride());
+            reader.ReadRows(low + kept, high - low - kept, window, kept, &window_alpha);
+        }
+        window_first = low;
+        window_count = high - low;
+
+        Band band{arena.Acquire(window_count, width), PlanarBuffer(), low, begin, end};
+        std::memcpy(band.rows.Data(), window.Data(), window_count * window.Stride());
+        if (!window_alpha.Empty()) {
+            band.alpha = PlanarBuffer(window_count, width, 1);
+            for (size_t i = 0; i < window_count; ++i) {
+                std::memcpy(band.alpha.Row(0, i), window_alpha.Row(0, i), width);
+            }
+        }
+        if (!bands.Push(std::move(band))) {
+            break;
+        }
+    }
+    arena.Release(std::move(window));
+}
+
+void BandPipeline::FilterBands(const BMPHeaders &headers, SpscQueue<Band> &bands, SpscQueue<Band> &filtered) const {
+    Band band;
+    while (bands.Pop(band)) {
+        Image band_image(headers, std::move(band.rows));
+        FilterFactory::ApplyFilters(band_image, filters_);
+        band_image.SetLayout(PixelLayout::Interleaved); // while the band is still in cache
+        band.rows = std::move(band_image.pixel_storage_);
+        if (!filtered.Push(std::move(band))) {
+            return;
+        }
+    }
+}
+
+void BandPipeline::WriteBands(BMPWriter &writer, const std::string &output_file, SpscQueue<Band> &filtered) {
+    Band band;
+    while (filtered.Pop(band)) {
+        ProfileScope scope("write", output_file, (band.end - band.begin) * band.rows.Stride());
+        for (size_t row = band.begin; row < band.end; ++row) {
+            writer.WriteRow(band.rows.Row(row - band.first),
+                            band.alpha.Empty() ? nullptr : band.alpha.Row(0, row - band.first));
+        }
+        ScratchArena::Instance().Release(std::move(band.rows)); // the reader takes it for one of the next bands
+        band.alpha.Clear();
+    }
+}
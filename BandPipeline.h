@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Filter.h"
+#include "BMPReader.h"
+#include "BMPWriter.h"
+#include "SpscQueue.h"
+#include <memory>
+
+// Applies a filter chain band by band, peak memory is O(width * band height). A reader thread reads bands ahead,
+// the calling thread filters them on the thread pool and a writer thread writes the finished ones, so disk time
+// hides behind compute time.
+class BandPipeline {
+public:
+    static constexpr size_t kDefaultBandHeight = 128;
+    static constexpr size_t kQueueDepth = 4; // bands waiting between two stages
+
+    BandPipeline(std::vector<std::shared_ptr<Filter>> filters, size_t band_height = kDefaultBandHeight);
+
+    static bool CanStream(const std::vector<std::shared_ptr<Filter>> &filters);
+
+    size_t Halo() const; // rows of context the whole chain needs above and below every band
+
+    // returns the number of pixels of the input image
+    size_t Run(const std::string &input_file, const std::string &output_file,
+               WriteMode mode = WriteMode::Buffered, Compression compression = Compression::None) const;
+
+private:
+    struct Band {
+        ImageBuffer rows; // file rows [first, first + rows.Height()), with the halo around the band
+        PlanarBuffer alpha; // alpha of the same rows for 32-bit files, filters don't touch it
+        size_t first = 0;
+        size_t begin = 0; // the band itself, rows [begin, end) of the file
+        size_t end = 0;
+    };
+
+    void ReadBands(const BMPReader &reader, const std::string &input_file, SpscQueue<Band> &bands) const;
+
+    void FilterBands(const BMPHeaders &headers, SpscQueue<Band> &bands, SpscQueue<Band> &filtered) const;
+
+    static void WriteBands(BMPWriter &writer, const std::string &output_file, SpscQueue<Band> &filtered);
+
+    std::vector<std::shared_ptr<Filter>> filters_;
+    size_t band_height_;
+};
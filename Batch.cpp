@@ -0,0 +1,126 @@
+#include "Batch.h"
+#include "BandPipeline.h"
+#include "FilterFactory.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+std::string BatchStats::Describe() const {
+    std::stringstream out;
+    double megapixels = static_cast<double>(pixels) / 1e6;
+    double megabytes = static_cast<double>(bytes) / 1e6;
+    out << "Filtered " << images << " of " << images + failed << " images (" << megapixels << " MP) in " << seconds
+        << " s: " << megapixels / seconds << " MP/s, " << megabytes / seconds << " MB/s, "
+        << static_cast<double>(images) / seconds << " images/s\n";
+    return out.str();
+}
+
+size_t ProcessImage(const std::vector<std::shared_ptr<Filter>> &filters, const std::string &input_file,
+                    const std::string &output_file, Compression compression) {
+    if (BandPipeline::CanStream(filters)) { // the same result without holding the whole image in memory
+        return BandPipeline(filters).Run(input_file, output_file, WriteMode::Buffered, compression);
+    }
+    Image image(input_file);
+    size_t pixels = image.Width() * image.Height();
+    FilterFactory::ApplyFilters(image, filters);
+    image.Write(output_file, WriteMode::Buffered, compression);
+    return pixels;
+}
+
+BatchRunner::BatchRunner(std::vector<std::shared_ptr<Filter>> filters, size_t jobs, Compression compression)
+        : filters_(std::move(filters)), jobs_(jobs == 0 ? kDefaultJobs : jobs), compression_(compression) {}
+
+std::vector<BatchJob> BatchRunner::ReadManifest(const std::string &manifest_file) {
+    std::ifstream manifest(manifest_file);
+    if (!manifest) {
+        throw std::runtime_error("Cannot open manifest file\n");
+    }
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (size_t number = 1; std::getline(manifest, line); ++number) {
+        std::stringstream words(line);
+        BatchJob job;
+        if (!(words >> job.input_file) || job.input_file[0] == '#') {
+            continue;
+        }
+        std::string extra;
+        if (!(words >> job.output_file) || words >> extra) {
+            throw std::runtime_error("Manifest line " + std::to_string(number) +
+                                     " must be an input and an output file\n");
+        } else if (job.input_file == job.output_file) {
+            throw std::runtime_error("Manifest line " + std::to_string(number) +
+                                     ": input and output file should be different files\n");
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+std::vector<BatchJob> BatchRunner::ListDirectory(const std::string &input_dir, const std::string &output_dir) {
+    namespace fs = std::filesystem;
+    if (!fs::is_directory(input_dir)) {
+        throw std::runtime_error("Cannot open input directory\n");
+    }
+    fs::create_directories(output_dir);
+    if (fs::equivalent(input_dir, output_dir)) {
+        throw std::runtime_error("Input and output directories should be different, so that inputs are unchanged\n");
+    }
+    std::vector<BatchJob> jobs;
+    for (const auto &entry: fs::directory_iterator(input_dir)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file() && extension == ".bmp") {
+            jobs.push_back({entry.path().string(), (fs::path(output_dir) / entry.path().filename()).string()});
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob &first, const BatchJob &second) {
+        return first.input_file < second.input_file;
+    });
+    return jobs;
+}
+
+BatchStats BatchRunner::Run(const std::vector<BatchJob> &jobs, std::ostream &errors) const {
+    BatchStats stats;
+    std::mutex mutex; // guards stats and errors
+    std::atomic<size_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+
+    // every worker takes the next image and reads, filters and writes it, so the stages of different images overlap;
+    // the filters themselves still spread every image over the shared thread pool
+    auto work = [this, &jobs, &errors, &stats, &mutex, &next]() {
+        for (size_t index = next++; index < jobs.size(); index = next++) {
+            const BatchJob &job = jobs[index];
+            try {
+                size_t pixels = ProcessImage(filters_, job.input_file, job.output_file, compression_);
+                size_t bytes = std::filesystem::file_size(job.input_file) + std::filesystem::file_size(job.output_file);
+                std::lock_guard lock(mutex);
+                ++stats.images;
+                stats.pixels += pixels;
+                stats.bytes += bytes;
+            } catch (std::exception &e) {
+                std::lock_guard lock(mutex);
+                ++stats.failed;
+                errors << job.input_file << ": " << e.what();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t worker = 1; worker < std::min(jobs_, jobs.size()); ++worker) {
+        workers.emplace_back(work);
+    }
+    work(); // the calling thread is a worker too
+    for (auto &worker: workers) {
+        worker.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.seconds = elapsed.count();
+    return stats;
+}
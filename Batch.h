@@ -0,0 +1,51 @@
+#pragma once
+
+#include "BMPFormat.h"
+#include "Filter.h"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BatchJob {
+    std::string input_file;
+    std::string output_file;
+};
+
+struct BatchStats {
+    size_t images = 0; // filtered successfully
+    size_t failed = 0;
+    size_t pixels = 0; // of the filtered input images
+    size_t bytes = 0; // of the input and output files
+    double seconds = 0;
+
+    std::string Describe() const; // one line of aggregate throughput
+};
+
+// filters one image the way a single run does: band by band if the chain allows it, the whole image otherwise,
+// returns the number of pixels of the input image
+size_t ProcessImage(const std::vector<std::shared_ptr<Filter>> &filters, const std::string &input_file,
+                    const std::string &output_file, Compression compression = Compression::None);
+
+class BatchRunner { // applies one filter chain to many images, a few images are in flight at once
+public:
+    static constexpr size_t kDefaultJobs = 3; // one image can be read while another is filtered and a third written
+
+    // 0 jobs means the default
+    BatchRunner(std::vector<std::shared_ptr<Filter>> filters, size_t jobs = kDefaultJobs,
+                Compression compression = Compression::None);
+
+    // an "input output" pair of paths per line, empty lines and lines starting with # are skipped
+    static std::vector<BatchJob> ReadManifest(const std::string &manifest_file);
+
+    // every .bmp file of input_dir in name order, the outputs get the same names in output_dir
+    static std::vector<BatchJob> ListDirectory(const std::string &input_dir, const std::string &output_dir);
+
+    // an image that fails is reported to errors and counted, the rest of the batch goes on
+    BatchStats Run(const std::vector<BatchJob> &jobs, std::ostream &errors) const;
+
+private:
+    std::vector<std::shared_ptr<Filter>> filters_;
+    size_t jobs_;
+    Compression compression_;
+};
@@ -0,0 +1,113 @@
+#include "Convolution.h"
+#include <cmath>
+
+namespace {
+
+const int kFixedShift = 12; // runtime coefficients are applied in 1/4096
+
+#ifdef BMP_EDITOR_X86_CONVOLUTION
+
+__attribute__((target("avx2"))) size_t AccumulateAVX2(int32_t *sums, const uint8_t *source, ptrdiff_t offset,
+                                                      size_t x, size_t end, int32_t weight) {
+    __m256i factor = _mm256_set1_epi32(weight);
+    for (; x + 8 <= end; x += 8) {
+        __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(source + (x + offset))));
+        __m256i *address = reinterpret_cast<__m256i *>(sums + x);
+        _mm256_storeu_si256(address, _mm256_add_epi32(_mm256_loadu_si256(address),
+                                                      _mm256_mullo_epi32(values, factor)));
+    }
+    return x;
+}
+
+#endif
+
+// sums[x] += weight * source[x + offset] for x in [begin, end)
+void Accumulate(int32_t *sums, const uint8_t *source, ptrdiff_t offset, size_t begin, size_t end, int32_t weight,
+                bool avx2) {
+    size_t x = begin;
+#ifdef BMP_EDITOR_X86_CONVOLUTION
+    if (avx2) {
+        x = AccumulateAVX2(sums, source, offset, x, end, weight);
+    }
+#endif
+    for (; x < end; ++x) {
+        sums[x] += weight * source[x + offset];
+    }
+}
+
+}
+
+void ConvolveNxN(const ImageBuffer &source, ImageBuffer &target, size_t size, const std::vector<double> &weights,
+                 const RowEpilogue &epilogue) {
+    size_t height = source.Height();
+    size_t width = source.Width();
+    if (height == 0 || width == 0) {
+        return;
+    }
+    size_t radius = size / 2;
+    std::vector<int32_t> fixed_weights;
+    fixed_weights.reserve(weights.size());
+    for (double weight: weights) {
+        fixed_weights.push_back(static_cast<int32_t>(std::lround(weight * (1 << kFixedShift))));
+    }
+    bool avx2 = CpuSupportsAVX2();
+
+    // pixels closer than radius to the left or right edge need clamped columns, the rest is vectorized
+    size_t interior_begin = std::min(radius, width);
+    size_t interior_end = width > 2 * radius ? width - radius : interior_begin;
+
+    target.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, height, [&](size_t begin, size_t end) {
+        std::vector<int32_t> sums(width * 3);
+        std::vector<const uint8_t *> rows(size);
+
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t di = 0; di < size; ++di) {
+                size_t row = std::clamp<ptrdiff_t>(static_cast<ptrdiff_t>(i + di) - static_cast<ptrdiff_t>(radius),
+                                                   0, static_cast<ptrdiff_t>(height) - 1);
+                rows[di] = reinterpret_cast<const uint8_t *>(source.Row(row));
+            }
+            std::fill(sums.begin(), sums.end(), 0);
+
+            for (size_t di = 0; di < size; ++di) {
+                for (size_t dj = 0; dj < size; ++dj) {
+                    int32_t weight = fixed_weights[di * size + dj];
+                    if (weight != 0 && interior_begin < interior_end) {
+                        ptrdiff_t offset = 3 * (static_cast<ptrdiff_t>(dj) - static_cast<ptrdiff_t>(radius));
+                        Accumulate(sums.data(), rows[di], offset, 3 * interior_begin, 3 * interior_end, weight,
+                                   avx2);
+                    }
+                }
+            }
+
+            auto border = [&](size_t j) {
+                for (size_t channel = 0; channel < 3; ++channel) {
+                    int32_t sum = 0;
+                    for (size_t di = 0; di < size; ++di) {
+                        for (size_t dj = 0; dj < size; ++dj) {
+                            ptrdiff_t column = static_cast<ptrdiff_t>(j + dj) - static_cast<ptrdiff_t>(radius);
+                            column = std::clamp<ptrdiff_t>(column, 0, static_cast<ptrdiff_t>(width) - 1);
+                            sum += fixed_weights[di * size + dj] * rows[di][3 * column + channel];
+                        }
+                    }
+                    sums[3 * j + channel] = sum;
+                }
+            };
+            for (size_t j = 0; j < interior_begin; ++j) {
+                border(j);
+            }
+            for (size_t j = interior_end; j < width; ++j) {
+                border(j);
+            }
+
+            uint8_t *out = reinterpret_cast<uint8_t *>(target.Row(i));
+            for (size_t x = 0; x < width * 3; ++x) {
+                int32_t value = (sums[x] + (1 << (kFixedShift - 1))) >> kFixedShift;
+                out[x] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+            }
+            if (epilogue) {
+                epilogue(target.Row(i), width);
+            }
+        }
+    });
+}
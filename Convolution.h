@@ -0,0 +1,194 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include "PixelKernels.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMP_EDITOR_X86_CONVOLUTION
+#endif
+
+// Convolution engine. Borders are handled by repeating the edge rows and columns, so no padded copy is needed.
+// Channels of a pixel never mix, so a row is convolved as a plain byte array where the horizontal neighbours
+// of a byte are 3 bytes away.
+
+// called on every output row as soon as it is computed, while it is still in cache
+using RowEpilogue = std::function<void(Pixel *row, size_t count)>;
+
+struct Kernel3x3 { // integer coefficients known at compile time
+    int weights[3][3];
+};
+
+inline constexpr Kernel3x3 kSharpeningKernel{{{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}}};
+inline constexpr Kernel3x3 kEdgeDetectionKernel{{{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}}};
+
+// writes source convolved with an arbitrary odd-sized square kernel into target (of the same size),
+// the coefficients are applied in 1/4096 fixed point, so integer kernels give exact results; sums are 32-bit, the
+// parser only lets through kernels whose sum for any neighbourhood fits
+void ConvolveNxN(const ImageBuffer &source, ImageBuffer &target, size_t size, const std::vector<double> &weights,
+                 const RowEpilogue &epilogue = {});
+
+namespace convolution_detail {
+
+template <Kernel3x3 K>
+constexpr bool FitsInt16() { // the largest possible sum has to fit into 16-bit lanes
+    int positive = 0, negative = 0;
+    for (const auto &row: K.weights) {
+        for (int weight: row) {
+            (weight > 0 ? positive : negative) += weight;
+        }
+    }
+    return positive * 255 <= 32767 && negative * 255 >= -32768;
+}
+
+template <Kernel3x3 K>
+inline uint8_t Byte(const uint8_t *const rows[3], size_t left, size_t middle, size_t right) {
+    int sum = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        sum += K.weights[i][0] * rows[i][left] + K.weights[i][1] * rows[i][middle] + K.weights[i][2] * rows[i][right];
+    }
+    return static_cast<uint8_t>(std::clamp(sum, 0, 255));
+}
+
+#ifdef BMP_EDITOR_X86_CONVOLUTION
+
+template <int Weight>
+inline __m128i MultiplyAdd(__m128i sum, __m128i values) { // zero and unit weights cost nothing
+    if constexpr (Weight == 0) {
+        return sum;
+    } else if constexpr (Weight == 1) {
+        return _mm_add_epi16(sum, values);
+    } else if constexpr (Weight == -1) {
+        return _mm_sub_epi16(sum, values);
+    } else {
+        return _mm_add_epi16(sum, _mm_mullo_epi16(values, _mm_set1_epi16(Weight)));
+    }
+}
+
+template <int Weight>
+__attribute__((target("avx2"))) inline __m256i MultiplyAdd(__m256i sum, __m256i values) {
+    if constexpr (Weight == 0) {
+        return sum;
+    } else if constexpr (Weight == 1) {
+        return _mm256_add_epi16(sum, values);
+    } else if constexpr (Weight == -1) {
+        return _mm256_sub_epi16(sum, values);
+    } else {
+        return _mm256_add_epi16(sum, _mm256_mullo_epi16(values, _mm256_set1_epi16(Weight)));
+    }
+}
+
+template <Kernel3x3 K, size_t TapRow, size_t TapColumn>
+inline void Tap16(const uint8_t *const rows[3], size_t x, __m128i &low, __m128i &high) {
+    if constexpr (K.weights[TapRow][TapColumn] != 0) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[TapRow] + x + 3 * TapColumn - 3));
+        __m128i zero = _mm_setzero_si128();
+        low = MultiplyAdd<K.weights[TapRow][TapColumn]>(low, _mm_unpacklo_epi8(values, zero));
+        high = MultiplyAdd<K.weights[TapRow][TapColumn]>(high, _mm_unpackhi_epi8(values, zero));
+    }
+}
+
+template <Kernel3x3 K, size_t TapRow, size_t TapColumn>
+__attribute__((target("avx2"))) inline void Tap32(const uint8_t *const rows[3], size_t x, __m256i &low,
+                                                  __m256i &high) {
+    if constexpr (K.weights[TapRow][TapColumn] != 0) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[TapRow] + x + 3 * TapColumn - 3));
+        low = MultiplyAdd<K.weights[TapRow][TapColumn]>(low, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(values)));
+        high = MultiplyAdd<K.weights[TapRow][TapColumn]>(high, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(values, 1)));
+    }
+}
+
+// interior bytes from x on, 16 at a time, returns the first byte left for the next loop
+template <Kernel3x3 K>
+size_t InteriorSSE2(const uint8_t *const rows[3], uint8_t *out, size_t x, size_t length) {
+    for (; x + 16 + 3 <= length; x += 16) {
+        __m128i low = _mm_setzero_si128(), high = _mm_setzero_si128();
+        Tap16<K, 0, 0>(rows, x, low, high);
+        Tap16<K, 0, 1>(rows, x, low, high);
+        Tap16<K, 0, 2>(rows, x, low, high);
+        Tap16<K, 1, 0>(rows, x, low, high);
+        Tap16<K, 1, 1>(rows, x, low, high);
+        Tap16<K, 1, 2>(rows, x, low, high);
+        Tap16<K, 2, 0>(rows, x, low, high);
+        Tap16<K, 2, 1>(rows, x, low, high);
+        Tap16<K, 2, 2>(rows, x, low, high);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_packus_epi16(low, high)); // clamps to 0..255
+    }
+    return x;
+}
+
+template <Kernel3x3 K>
+__attribute__((target("avx2"))) size_t InteriorAVX2(const uint8_t *const rows[3], uint8_t *out, size_t x,
+                                                    size_t length) {
+    for (; x + 32 + 3 <= length; x += 32) {
+        __m256i low = _mm256_setzero_si256(), high = _mm256_setzero_si256();
+        Tap32<K, 0, 0>(rows, x, low, high);
+        Tap32<K, 0, 1>(rows, x, low, high);
+        Tap32<K, 0, 2>(rows, x, low, high);
+        Tap32<K, 1, 0>(rows, x, low, high);
+        Tap32<K, 1, 1>(rows, x, low, high);
+        Tap32<K, 1, 2>(rows, x, low, high);
+        Tap32<K, 2, 0>(rows, x, low, high);
+        Tap32<K, 2, 1>(rows, x, low, high);
+        Tap32<K, 2, 2>(rows, x, low, high);
+        // packus works per 128-bit lane, the permutation puts the 32 results back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), packed);
+    }
+    return x;
+}
+
+#endif
+
+template <Kernel3x3 K>
+void Row(const uint8_t *const rows[3], uint8_t *out, size_t width, bool avx2) {
+    size_t length = width * 3;
+    size_t x = 3; // bytes [3, length - 3) have both horizontal neighbours inside the row
+#ifdef BMP_EDITOR_X86_CONVOLUTION
+    if (avx2) {
+        x = InteriorAVX2<K>(rows, out, x, length);
+    }
+    x = InteriorSSE2<K>(rows, out, x, length);
+#endif
+    for (; x + 3 < length; ++x) {
+        out[x] = Byte<K>(rows, x - 3, x, x + 3);
+    }
+    for (size_t channel = 0; channel < 3; ++channel) { // the first and the last pixel repeat themselves outside
+        size_t last = length - 3 + channel;
+        out[channel] = Byte<K>(rows, channel, channel, width > 1 ? channel + 3 : channel);
+        out[last] = Byte<K>(rows, width > 1 ? last - 3 : last, last, last);
+    }
+}
+
+}
+
+template <Kernel3x3 K>
+void Convolve3x3(const ImageBuffer &source, ImageBuffer &target, const RowEpilogue &epilogue = {}) {
+    static_assert(convolution_detail::FitsInt16<K>(), "kernel sums do not fit into 16-bit lanes");
+
+    size_t height = source.Height();
+    size_t width = source.Width();
+    if (height == 0 || width == 0) {
+        return;
+    }
+    bool avx2 = CpuSupportsAVX2();
+
+    target.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, height, [&source, &target, &epilogue, height, width, avx2](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint8_t *rows[3] = {
+                    reinterpret_cast<const uint8_t *>(source.Row(i == 0 ? 0 : i - 1)),
+                    reinterpret_cast<const uint8_t *>(source.Row(i)),
+                    reinterpret_cast<const uint8_t *>(source.Row(i + 1 == height ? i : i + 1)),
+            };
+            convolution_detail::Row<K>(rows, reinterpret_cast<uint8_t *>(target.Row(i)), width, avx2);
+            if (epilogue) {
+                epilogue(target.Row(i), width);
+            }
+        }
+    });
+}
@@ -1,134 +1,365 @@
 #include "Filter.h"
+#include "Convolution.h"
+#include "IntegralImage.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include <algorithm>
 #include <cmath>
 #include <random>
 #include <stdexcept>
+#include <utility>
+
+namespace {
+
+const size_t kStripBytes = 1024; // columns of one vertical blur strip, their running sums stay in L1
+
+// the sums of every channel over the (2 * radius + 1)^2 squares around the pixels of row i, 3 * width of them,
+// squares sticking out of the image repeat its edge pixels
+void SquareSums(const IntegralImage &integral, size_t radius, size_t i, uint32_t *sums) {
+    size_t height = integral.Height();
+    size_t width = integral.Width();
+    size_t side = 2 * radius + 1;
+    auto reach = static_cast<ptrdiff_t>(radius);
+    auto y = static_cast<ptrdiff_t>(i);
+    // squares of the inner pixels lie inside the image, they are summed for the whole row at once
+    bool inner_row = i >= radius && i + radius < height;
+    size_t first = inner_row ? std::min(radius, width) : width;
+    size_t last = inner_row && width > 2 * radius ? width - radius : first;
+    if (first < last) {
+        integral.WindowSums(i - radius, i + radius + 1, first - radius, side, last - first, sums + first * 3);
+    }
+    auto edge = [&](size_t j) {
+        auto x = static_cast<ptrdiff_t>(j);
+        auto edge_sums = integral.ClampedSum(y - reach, x - reach, y + reach + 1, x + reach + 1);
+        std::copy(edge_sums.begin(), edge_sums.end(), sums + j * 3);
+    };
+    for (size_t j = 0; j < std::min(first, last); ++j) {
+        edge(j);
+    }
+    for (size_t j = last; j < width; ++j) {
+        edge(j);
+    }
+}
 
-std::vector<std::vector<Pixel>> WrapMatrix(const std::vector<std::vector<Pixel>> &pixel_matrix) {
-    std::vector<std::vector<Pixel>> matrix_wrap;
+// target gets the rounded mean of the (2 * radius + 1)^2 square around every pixel of source,
+// squares sticking out of the image repeat its edge pixels
+void BoxMean(const ImageBuffer &source, ImageBuffer &target, size_t radius) {
+    size_t side = 2 * radius + 1;
+    if (side * side > IntegralImage::kMaxArea) {
+        throw std::runtime_error("Box is too large\n");
+    }
+    IntegralImage integral(source);
+    size_t height = source.Height();
+    size_t width = source.Width();
+    // (2 * sum + area) / (2 * area) rounded down is the mean rounded half up; sums are far below 2^53 and the
+    // quotient is never closer than 1 / (2 * area) to the next integer, so a double reciprocal gives it exactly
+    double inverse = 1.0 / (2.0 * static_cast<double>(side * side));
+    auto mean = [inverse, side](uint32_t sum) {
+        return static_cast<uint8_t>((2.0 * sum + static_cast<double>(side * side)) * inverse);
+    };
+
+    target.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, height, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> sums(width * 3);
+        for (size_t i = begin; i < end; ++i) {
+            auto *row = reinterpret_cast<uint8_t *>(target.Row(i));
+            SquareSums(integral, radius, i, sums.data());
+            for (size_t x = 0; x < width * 3; ++x) {
+                row[x] = mean(sums[x]);
+            }
+        }
+    });
+}
 
-    matrix_wrap.resize(pixel_matrix.size() + 2);
+}
+
+FilterKind Filter::Kind() const {
+    return FilterKind::Global;
+}
 
-    matrix_wrap[0].push_back(Pixel{0, 0, 0});
-    for (const auto &pixel: pixel_matrix[0]) {
-        matrix_wrap[0].push_back(pixel);
+PixelLayout Filter::Layout() const {
+    return PixelLayout::Interleaved;
+}
+
+size_t Filter::Halo() const {
+    return kWholeImage;
+}
+
+void Filter::SetLabel(std::string label) {
+    label_ = std::move(label);
+}
+
+const std::string &Filter::Label() const {
+    return label_;
+}
+
+void RowFilter::Prepare() {}
+
+void RowFilter::ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const {
+    const size_t kChunk = 256;
+    Pixel pixels[kChunk];
+    for (size_t begin = 0; begin < count; begin += kChunk) {
+        size_t length = std::min(kChunk, count - begin);
+        MergeRow(red + begin, green + begin, blue + begin, length, pixels);
+        ApplyRow(pixels, length);
+        SplitRow(pixels, length, red + begin, green + begin, blue + begin);
     }
-    matrix_wrap[0].push_back(Pixel{0, 0, 0});
+}
 
-    for (size_t i = 0; i < pixel_matrix.size(); ++i) {
-        matrix_wrap[i + 1].push_back(pixel_matrix[i][0]);
-        for (const auto &pixel: pixel_matrix[i]) {
-            matrix_wrap[i + 1].push_back(pixel);
+void RowFilter::Apply(Image &image) {
+    Prepare();
+    if (image.layout_ == PixelLayout::Planar) {
+        ParallelFor(0, image.planes_.Height(), [this, &image](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                ApplyPlanarRow(image.planes_.Row(0, i), image.planes_.Row(1, i), image.planes_.Row(2, i),
+                               image.planes_.Width());
+            }
+        });
+        return;
+    }
+    image.pixel_storage_.MakeWritable(); // rows are shared between threads
+    // the buffer may still be flipped or transposed (see Image::Materialize), every pixel is changed all the same
+    ParallelFor(0, image.pixel_storage_.Height(), [this, &image](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            ApplyRow(image.pixel_storage_.Row(i), image.pixel_storage_.Width());
         }
-        matrix_wrap[i + 1].push_back(pixel_matrix[i][pixel_matrix[0].size() - 1]);
+    });
+}
+
+FilterKind RowFilter::Kind() const {
+    return FilterKind::Point;
+}
+
+size_t RowFilter::Halo() const {
+    return 0;
+}
+
+FusedRowFilter::FusedRowFilter(std::vector<std::shared_ptr<RowFilter>> filters) : filters_(std::move(filters)) {}
+
+void FusedRowFilter::Append(std::shared_ptr<RowFilter> filter) {
+    auto previous_table = filters_.empty() ? nullptr : std::dynamic_pointer_cast<PointFilter>(filters_.back());
+    auto next_table = std::dynamic_pointer_cast<PointFilter>(filter);
+    if (previous_table && next_table) {
+        filters_.back() = std::make_shared<FusedPointFilter>(
+                std::vector<std::shared_ptr<PointFilter>>{previous_table, next_table});
+    } else {
+        filters_.push_back(std::move(filter));
     }
+}
 
-    matrix_wrap[pixel_matrix.size() + 1].push_back(Pixel{0, 0, 0});
-    for (const auto &pixel: pixel_matrix[pixel_matrix.size() - 1]) {
-        matrix_wrap[pixel_matrix.size() + 1].push_back(pixel);
+std::shared_ptr<RowFilter> FusedRowFilter::Single() const {
+    return filters_.size() == 1 ? filters_.front() : nullptr;
+}
+
+void FusedRowFilter::Prepare() {
+    for (const auto &filter: filters_) {
+        filter->Prepare();
     }
-    matrix_wrap[pixel_matrix.size() + 1].push_back(Pixel{0, 0, 0});
+}
 
-    return matrix_wrap;
+void FusedRowFilter::ApplyRow(Pixel *row, size_t count) const {
+    for (const auto &filter: filters_) { // the row is still in cache when the next filter gets it
+        filter->ApplyRow(row, count);
+    }
 }
 
-void Apply3x3Matrix(Image &image, const std::vector<std::vector<double>> &matrix) { // no need for NxN matrices
-    auto matrix_wrap = WrapMatrix(image.pixel_storage_);
+void FusedRowFilter::ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const {
+    for (const auto &filter: filters_) {
+        filter->ApplyPlanarRow(red, green, blue, count);
+    }
+}
 
-    for (size_t i = 0; i < image.headers_info_.height_; ++i) {
-        for (size_t j = 0; j < image.headers_info_.width_; ++j) {
-            double color_red = 0, color_green = 0, color_blue = 0;
+PixelLayout FusedRowFilter::Layout() const {
+    bool planar = false;
+    bool interleaved = false;
+    for (const auto &filter: filters_) {
+        planar = planar || filter->Layout() == PixelLayout::Planar;
+        interleaved = interleaved || filter->Layout() == PixelLayout::Interleaved;
+    }
+    if (planar == interleaved) { // either nobody cares or both are wanted, then the image stays as it is
+        return PixelLayout::Any;
+    }
+    return planar ? PixelLayout::Planar : PixelLayout::Interleaved;
+}
 
-            for (size_t fi = 0; fi < 3; ++fi) {
-                for (size_t fj = 0; fj < 3; ++fj) {
-                    color_red += matrix[fi][fj] * matrix_wrap[i + fi][j + fj].red;
-                    color_green += matrix[fi][fj] * matrix_wrap[i + fi][j + fj].green;
-                    color_blue += matrix[fi][fj] * matrix_wrap[i + fi][j + fj].blue;
-                }
-            }
+void StencilFilter::SetEpilogue(std::shared_ptr<RowFilter> epilogue) {
+    epilogue_ = std::move(epilogue);
+}
+
+FilterKind StencilFilter::Kind() const {
+    return FilterKind::Stencil;
+}
+
+void PointFilter::Prepare() {
+    std::call_once(table_built_, [this]() { table_ = BuildTable(); });
+}
+
+void PointFilter::ApplyRow(Pixel *row, size_t count) const {
+    LookupRow(row, count, table_.data());
+}
+
+void PointFilter::ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const {
+    for (auto *plane: {red, green, blue}) {
+        LookupBytes(plane, count, table_.data());
+    }
+}
 
-            uint8_t pixel_red = static_cast<uint8_t>(std::min(255.0, std::max(0.0, color_red)));
-            uint8_t pixel_green = static_cast<uint8_t>(std::min(255.0, std::max(0.0, color_green)));
-            uint8_t pixel_blue = static_cast<uint8_t>(std::min(255.0, std::max(0.0, color_blue)));
+PixelLayout PointFilter::Layout() const {
+    return PixelLayout::Any;
+}
 
-            image.pixel_storage_[i][j] = Pixel{pixel_red, pixel_green, pixel_blue};
+FusedPointFilter::FusedPointFilter(const std::vector<std::shared_ptr<PointFilter>> &filters) {
+    for (size_t value = 0; value < table_.size(); ++value) {
+        table_[value] = value;
+    }
+    for (const auto &filter: filters) { // the filters are applied in order, so their tables compose left to right
+        Table next = filter->BuildTable();
+        for (auto &value: table_) {
+            value = next[value];
         }
     }
 }
 
+PointFilter::Table FusedPointFilter::BuildTable() const {
+    return table_;
+}
+
 // Basic Filters
 
 Crop::Crop(size_t width, size_t height) : width_(width), height_(height) {}
 
 void Crop::Apply(Image &image) {
-    if (image.headers_info_.height_ > height_) {
-        image.headers_info_.height_ = height_;
+    size_t height = std::min(image.Height(), height_);
+    size_t width = std::min(image.Width(), width_);
+    // rows are numbered bottom-up, so the top of the image is kept by skipping the first rows; the pixels don't move,
+    // the image gets a view of them, wherever pending flips and transposes have them
+    const ImageBuffer &pixels = image.pixel_storage_;
+    Orientation::Region region = image.orientation_.Locate({image.Height() - height, 0, height, width},
+                                                           pixels.Height(), pixels.Width());
+    image.pixel_storage_ = std::move(image.pixel_storage_).View(region.first_row, region.first_column, region.height,
+                                                                 region.width);
+    if (!image.alpha_.Empty()) { // the alpha of 32-bit images is cut the same way
+        image.alpha_ = std::move(image.alpha_).View(region.first_row, region.first_column, region.height,
+                                                     region.width);
+    }
+    image.headers_info_.height_ = height;
+    image.headers_info_.width_ = width;
+}
+
+FilterKind Crop::Kind() const {
+    return FilterKind::Geometric;
+}
+
+std::shared_ptr<Crop> Crop::Merge(const Crop &other) const {
+    return std::make_shared<Crop>(std::min(width_, other.width_), std::min(height_, other.height_));
+}
+
+Reorientation::Reorientation(Orientation orientation) : orientation_(orientation) {}
+
+void Reorientation::Apply(Image &image) {
+    image.orientation_ = image.orientation_.Then(orientation_);
+    if (orientation_.transposed) {
+        size_t width = image.Width();
+        image.headers_info_.width_ = image.Height();
+        image.headers_info_.height_ = width;
+    }
+}
+
+FilterKind Reorientation::Kind() const {
+    return FilterKind::Geometric;
+}
+
+PixelLayout Reorientation::Layout() const {
+    return PixelLayout::Any;
+}
+
+Resize::Resize(size_t width, size_t height, ResampleMethod method) : width_(width), height_(height), method_(method) {}
+
+void Resize::Apply(Image &image) {
+    if (image.Height() == height_ && image.Width() == width_) {
+        return;
     }
-    if (image.headers_info_.width_ > width_) {
-        image.headers_info_.width_ = width_;
+    ImageBuffer result = Resample(image.pixel_storage_, height_, width_, method_);
+    ScratchArena::Instance().Release(std::exchange(image.pixel_storage_, std::move(result)));
+    if (!image.alpha_.Empty()) {
+        image.alpha_ = Resample(image.alpha_, height_, width_, method_);
     }
-    std::reverse(image.pixel_storage_.begin(), image.pixel_storage_.end());
-    image.pixel_storage_.resize(image.headers_info_.height_);
-    std::reverse(image.pixel_storage_.begin(), image.pixel_storage_.end());
+    image.headers_info_.height_ = height_;
+    image.headers_info_.width_ = width_;
 }
 
 Grayscale::Grayscale() {}
 
-void Grayscale::Apply(Image &image) {
-    for (size_t i = 0; i < image.headers_info_.height_; ++i) {
-        for (size_t j = 0; j < image.headers_info_.width_; ++j) {
-            Pixel temp_pixel = image.pixel_storage_[i][j];
-            image.pixel_storage_[i][j].red =
-                    0.299 * temp_pixel.red + 0.587 * temp_pixel.green + 0.114 * temp_pixel.blue;
-            image.pixel_storage_[i][j].green =
-                    0.299 * temp_pixel.red + 0.587 * temp_pixel.green + 0.114 * temp_pixel.blue;
-            image.pixel_storage_[i][j].blue =
-                    0.299 * temp_pixel.red + 0.587 * temp_pixel.green + 0.114 * temp_pixel.blue;
-        }
-    }
+void Grayscale::ApplyRow(Pixel *row, size_t count) const {
+    GrayscaleRow(row, count);
+}
+
+void Grayscale::ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const {
+    GrayscalePlanes(red, green, blue, count);
+}
+
+PixelLayout Grayscale::Layout() const {
+    return PixelLayout::Planar;
 }
 
 Negative::Negative() {}
 
-void Negative::Apply(Image &image) {
-    for (size_t i = 0; i < image.headers_info_.height_; ++i) {
-        for (size_t j = 0; j < image.headers_info_.width_; ++j) {
-            Pixel temp_pixel = image.pixel_storage_[i][j];
-            image.pixel_storage_[i][j].red = 255 - temp_pixel.red;
-            image.pixel_storage_[i][j].green = 255 - temp_pixel.green;
-            image.pixel_storage_[i][j].blue = 255 - temp_pixel.blue;
-        }
+PointFilter::Table Negative::BuildTable() const {
+    Table table;
+    for (size_t value = 0; value < table.size(); ++value) {
+        table[value] = 255 - value;
     }
+    return table;
+}
+
+void Negative::ApplyRow(Pixel *row, size_t count) const {
+    NegativeRow(row, count);
 }
 
 Sharpening::Sharpening() {}
 
 void Sharpening::Apply(Image &image) {
-    Apply3x3Matrix(image, {{0,  -1, 0},
-                           {-1, 5,  -1},
-                           {0,  -1, 0}});
+    RowEpilogue epilogue;
+    if (epilogue_) {
+        epilogue_->Prepare();
+        epilogue = [this](Pixel *row, size_t count) { epilogue_->ApplyRow(row, count); };
+    }
+    ImageBuffer result = ScratchArena::Instance().Acquire(image.pixel_storage_.Height(), image.pixel_storage_.Width());
+    Convolve3x3<kSharpeningKernel>(image.pixel_storage_, result, epilogue);
+    ScratchArena::Instance().Release(std::exchange(image.pixel_storage_, std::move(result)));
+}
+
+size_t Sharpening::Halo() const {
+    return 1;
 }
 
 EdgeDetection::EdgeDetection(float threshold) : threshold_(threshold) {}
 
 void EdgeDetection::Apply(Image &image) {
-    Apply3x3Matrix(image, {{0,  -1, 0},
-                           {-1, 4,  -1},
-                           {0,  -1, 0}});
-
-    for (size_t i = 0; i < image.headers_info_.height_; ++i) {
-        for (auto &pixel: image.pixel_storage_[i]) {
-            if (0.299 * pixel.red + 0.567 * pixel.green + 0.114 * pixel.blue > 255.0 * threshold_) {
-                pixel = Pixel{255, 255, 255};
-            } else {
-                pixel = Pixel{0, 0, 0};
-            }
-        }
+    // brightness is compared in 1/256 units, the same as the fixed-point kernel computes it
+    auto threshold = static_cast<uint16_t>(std::min(65535.0, 255.0 * 256.0 * threshold_));
+    if (epilogue_) {
+        epilogue_->Prepare();
     }
+    RowEpilogue epilogue = [this, threshold](Pixel *row, size_t count) { // thresholds rows while they are hot
+        ThresholdRow(row, count, threshold);
+        if (epilogue_) {
+            epilogue_->ApplyRow(row, count);
+        }
+    };
+    ImageBuffer result = ScratchArena::Instance().Acquire(image.pixel_storage_.Height(), image.pixel_storage_.Width());
+    Convolve3x3<kEdgeDetectionKernel>(image.pixel_storage_, result, epilogue);
+    ScratchArena::Instance().Release(std::exchange(image.pixel_storage_, std::move(result)));
+}
+
+size_t EdgeDetection::Halo() const {
+    return 1;
 }
 
 GaussianBlur::GaussianBlur(float sigma) : sigma_(sigma) {}
 
-std::vector<size_t> GaussianBlur::BoxesForGauss(size_t n) {
+std::vector<size_t> GaussianBlur::BoxesForGauss(size_t n) const {
     // n - number of "boxes"
 
     std::vector<size_t> sizes;
@@ -151,108 +382,225 @@ std::vector<size_t> GaussianBlur::BoxesForGauss(size_t n) {
     return sizes;
 }
 
-void
-GaussianBlur::HorizontalBlur(const std::vector<std::vector<Pixel>> &source, std::vector<std::vector<Pixel>> &target,
-                             size_t radius) {
-    size_t height = source.size();
-    size_t width = source[0].size();
-
-    for (size_t i = 0; i < height; ++i) {
-
-        double val_red = (radius + 1) * source[i][0].red;
-        double val_green = (radius + 1) * source[i][0].green;
-        double val_blue = (radius + 1) * source[i][0].blue;
-        size_t left = 0, right = radius;
+void GaussianBlur::HorizontalBlur(const ImageBuffer &source, ImageBuffer &target, size_t radius) {
+    size_t width = source.Width();
+    size_t window = 2 * radius + 1;
+    if (window >= kMaxBoxWindow) {
+        throw std::runtime_error("Blur sigma is too large\n");
+    }
+    uint32_t reciprocal = BoxReciprocal(window);
+    if (width == 0) { // there are no edge pixels to repeat
+        return;
+    }
 
-        for (size_t j = 0; j < radius; ++j) {
-            val_red += source[i][j].red;
-            val_green += source[i][j].green;
-            val_blue += source[i][j].blue;
+    target.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, source.Height(), [&source, &target, radius, width, window, reciprocal](size_t begin, size_t end) {
+        // prefix sums of the row with radius edge pixels repeated on both sides, interleaved like the pixels
+        std::vector<uint32_t> prefix((width + 2 * radius + 1) * 3);
+        std::vector<uint32_t> sums(width * 3);
+        for (size_t i = begin; i < end; ++i) {
+            const auto *row = reinterpret_cast<const uint8_t *>(source.Row(i));
+            const uint8_t *first = row;
+            const uint8_t *last = row + (width - 1) * 3;
+            size_t x = 3;
+            prefix[0] = prefix[1] = prefix[2] = 0;
+            for (size_t k = 0; k < radius; ++k, x += 3) {
+                for (size_t channel = 0; channel < 3; ++channel) {
+                    prefix[x + channel] = prefix[x + channel - 3] + first[channel];
+                }
+            }
+            for (size_t k = 0; k < width * 3; ++k, ++x) {
+                prefix[x] = prefix[x - 3] + row[k];
+            }
+            for (size_t k = 0; k < radius; ++k, x += 3) {
+                for (size_t channel = 0; channel < 3; ++channel) {
+                    prefix[x + channel] = prefix[x + channel - 3] + last[channel];
+                }
+            }
+            for (size_t k = 0; k < width * 3; ++k) { // differences wrap around, but stay exact
+                sums[k] = prefix[k + window * 3] - prefix[k];
+            }
+            ScaleSums(sums.data(), width * 3, reciprocal, reinterpret_cast<uint8_t *>(target.Row(i)));
         }
+    });
+}
 
-        for (size_t j = 0; j < width; ++j) {
-            if (j <= radius) {
-                val_red += source[i][right].red - source[i][0].red;
-                val_green += source[i][right].green - source[i][0].green;
-                val_blue += source[i][right].blue - source[i][0].blue;
-                ++right;
-            } else if (j < width - radius) {
-                val_red += source[i][right].red - source[i][left].red;
-                val_green += source[i][right].green - source[i][left].green;
-                val_blue += source[i][right].blue - source[i][left].blue;
-                ++right;
-                ++left;
-            } else {
-                val_red += source[i][width - 1].red - source[i][left].red;
-                val_green += source[i][width - 1].green - source[i][left].green;
-                val_blue += source[i][width - 1].blue - source[i][left].blue;
-                ++left;
+void GaussianBlur::VerticalBlur(const ImageBuffer &source, ImageBuffer &target, size_t radius) {
+    size_t height = source.Height();
+    size_t window = 2 * radius + 1;
+    if (window >= kMaxBoxWindow) {
+        throw std::runtime_error("Blur sigma is too large\n");
+    }
+    uint32_t reciprocal = BoxReciprocal(window);
+    if (height == 0) { // there are no edge rows to repeat
+        return;
+    }
+
+    target.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, source.Width() * 3, [&](size_t begin, size_t end) {
+        auto last = static_cast<ptrdiff_t>(height) - 1;
+        auto row = [&source, last, begin](ptrdiff_t i) {
+            return reinterpret_cast<const uint8_t *>(source.Row(std::clamp<ptrdiff_t>(i, 0, last))) + begin;
+        };
+        auto reach = static_cast<ptrdiff_t>(radius);
+        std::vector<uint32_t> sums(end - begin, 0); // one running sum per byte of the strip
+        for (ptrdiff_t k = -reach; k <= reach; ++k) {
+            const uint8_t *in = row(k);
+            for (size_t x = 0; x < sums.size(); ++x) {
+                sums[x] += in[x];
             }
-            target[i][j].red = round(val_red / (2 * radius + 1));
-            target[i][j].green = round(val_green / (2 * radius + 1));
-            target[i][j].blue = round(val_blue / (2 * radius + 1));
         }
+        for (size_t i = 0; i < height; ++i) {
+            auto y = static_cast<ptrdiff_t>(i);
+            ScaleSums(sums.data(), sums.size(), reciprocal, reinterpret_cast<uint8_t *>(target.Row(i)) + begin);
+            SlideSums(sums.data(), row(y + reach + 1), row(y - reach), sums.size());
+        }
+    }, kStripBytes);
+}
+
+void GaussianBlur::BoxBlur(const ImageBuffer &source, ImageBuffer &temporary, ImageBuffer &target, size_t radius) {
+    HorizontalBlur(source, temporary, radius);
+    VerticalBlur(temporary, target, radius);
+}
+
+void GaussianBlur::Apply(Image &image) {
+    std::vector<size_t> boxes = BoxesForGauss(4); // can be > 4, but the result is almost the same
+    // the rounds ping-pong between two buffers, the image itself is only read by the first one
+    ScratchArena &arena = ScratchArena::Instance();
+    ImageBuffer temporary = arena.Acquire(image.pixel_storage_.Height(), image.pixel_storage_.Width());
+    ImageBuffer result = arena.Acquire(temporary.Height(), temporary.Width());
+    BoxBlur(image.pixel_storage_, temporary, result, (boxes[0] - 1) / 2);
+    for (size_t round = 1; round < boxes.size(); ++round) {
+        BoxBlur(result, temporary, result, (boxes[round] - 1) / 2);
     }
+    arena.Release(std::move(temporary));
+    arena.Release(std::exchange(image.pixel_storage_, std::move(result)));
 }
 
-void GaussianBlur::VerticalBlur(const std::vector<std::vector<Pixel>> &source, std::vector<std::vector<Pixel>> &target,
-                                size_t radius) {
-    size_t height = source.size();
-    size_t width = source[0].size();
+FilterKind GaussianBlur::Kind() const {
+    return FilterKind::Stencil;
+}
 
-    for (size_t j = 0; j < width; ++j) {
+size_t GaussianBlur::Halo() const {
+    size_t halo = 0; // every vertical box pass spreads a pixel by its radius
+    for (size_t box: BoxesForGauss(4)) {
+        halo += (box - 1) / 2;
+    }
+    return halo;
+}
 
-        double val_red = (radius + 1) * source[0][j].red;
-        double val_green = (radius + 1) * source[0][j].green;
-        double val_blue = (radius + 1) * source[0][j].blue;
-        size_t left = 0, right = radius;
+Convolution::Convolution(size_t size, std::vector<double> weights) : size_(size), weights_(std::move(weights)) {
+    if (size_ % 2 == 0 || weights_.size() != size_ * size_) {
+        throw std::runtime_error("Convolution kernel must be a square of an odd size\n");
+    }
+}
 
-        for (size_t i = 0; i < radius; ++i) {
-            val_red += source[i][j].red;
-            val_green += source[i][j].green;
-            val_blue += source[i][j].blue;
-        }
+void Convolution::Apply(Image &image) {
+    RowEpilogue epilogue;
+    if (epilogue_) {
+        epilogue_->Prepare();
+        epilogue = [this](Pixel *row, size_t count) { epilogue_->ApplyRow(row, count); };
+    }
+    ImageBuffer result = ScratchArena::Instance().Acquire(image.pixel_storage_.Height(), image.pixel_storage_.Width());
+    ConvolveNxN(image.pixel_storage_, result, size_, weights_, epilogue);
+    ScratchArena::Instance().Release(std::exchange(image.pixel_storage_, std::move(result)));
+}
 
-        for (size_t i = 0; i < height; ++i) {
-            if (i <= radius) {
-                val_red += source[right][j].red - source[0][j].red;
-                val_green += source[right][j].green - source[0][j].green;
-                val_blue += source[right][j].blue - source[0][j].blue;
-                ++right;
-            } else if (i < width - radius) {
-                val_red += source[right][j].red - source[left][j].red;
-                val_green += source[right][j].green - source[left][j].green;
-                val_blue += source[right][j].blue - source[left][j].blue;
-                ++right;
-                ++left;
-            } else {
-                val_red += source[height - 1][j].red - source[left][j].red;
-                val_green += source[height - 1][j].green - source[left][j].green;
-                val_blue += source[height - 1][j].blue - source[left][j].blue;
-                ++left;
+size_t Convolution::Halo() const {
+    return size_ / 2;
+}
+
+BoxFilter::BoxFilter(size_t radius) : radius_(radius) {}
+
+void BoxFilter::Apply(Image &image) {
+    ImageBuffer result = ScratchArena::Instance().Acquire(image.pixel_storage_.Height(), image.pixel_storage_.Width());
+    BoxMean(image.pixel_storage_, result, radius_);
+    ScratchArena::Instance().Release(std::exchange(image.pixel_storage_, std::move(result)));
+}
+
+FilterKind BoxFilter::Kind() const {
+    return FilterKind::Stencil;
+}
+
+size_t BoxFilter::Halo() const {
+    return radius_;
+}
+
+GuidedFilter::GuidedFilter(float sigma_spatial, float sigma_range) : epsilon_(sigma_range * sigma_range) {
+    if (!(sigma_spatial < static_cast<float>(kMaxRadius) + 0.5f)) {
+        throw std::runtime_error("Bilateral sigma_s is too large\n");
+    }
+    radius_ = static_cast<size_t>(std::lround(sigma_spatial));
+}
+
+void GuidedFilter::Apply(Image &image) {
+    const ImageBuffer &pixels = image.pixel_storage_; // only read, so mapped rows are never copied on write here
+    size_t height = pixels.Height();
+    size_t width = pixels.Width();
+    size_t stride = width * 3;
+    double inverse = 1.0 / static_cast<double>((2 * radius_ + 1) * (2 * radius_ + 1));
+    // q = mean(a) * p + mean(b), where a = var / (var + eps) and b = (1 - a) * mean(p) over every square; the means
+    // are box sums of summed-area tables, a and b are stored in 1/2^16 and 1/2^8 so that their sums fit in too
+    ScratchArena &arena = ScratchArena::Instance();
+    std::vector<uint32_t> a = arena.AcquireWords(height * stride);
+    std::vector<uint32_t> b = arena.AcquireWords(height * stride);
+    ParallelFor(0, height, [&](size_t begin, size_t end) { // squares of the pixels go to a first
+        for (size_t i = begin; i < end; ++i) {
+            const auto *row = reinterpret_cast<const uint8_t *>(pixels.Row(i));
+            for (size_t x = 0; x < stride; ++x) {
+                a[i * stride + x] = row[x] * row[x];
             }
-            target[i][j].red = round(val_red / (2 * radius + 1));
-            target[i][j].green = round(val_green / (2 * radius + 1));
-            target[i][j].blue = round(val_blue / (2 * radius + 1));
         }
+    });
+    {
+        IntegralImage means(pixels);
+        IntegralImage squares(a.data(), height, width);
+        ParallelFor(0, height, [&](size_t begin, size_t end) {
+            std::vector<uint32_t> mean_sums(stride);
+            std::vector<uint32_t> square_sums(stride);
+            for (size_t i = begin; i < end; ++i) {
+                SquareSums(means, radius_, i, mean_sums.data());
+                SquareSums(squares, radius_, i, square_sums.data());
+                for (size_t x = 0; x < stride; ++x) {
+                    double mean = mean_sums[x] * inverse;
+                    double variance = std::max(square_sums[x] * inverse - mean * mean, 0.0);
+                    double weight = variance / (variance + epsilon_);
+                    a[i * stride + x] = static_cast<uint32_t>(std::lround(weight * (1 << kWeightBits)));
+                    b[i * stride + x] = static_cast<uint32_t>(std::lround((1.0 - weight) * mean * (1 << kOffsetBits)));
+                }
+            }
+        });
     }
+    IntegralImage weights(a.data(), height, width);
+    IntegralImage offsets(b.data(), height, width);
+    arena.Release(std::move(a));
+    arena.Release(std::move(b));
+
+    ImageBuffer result = arena.Acquire(height, width);
+    ParallelFor(0, height, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> weight_sums(stride);
+        std::vector<uint32_t> offset_sums(stride);
+        for (size_t i = begin; i < end; ++i) {
+            const auto *row = reinterpret_cast<const uint8_t *>(pixels.Row(i));
+            auto *out = reinterpret_cast<uint8_t *>(result.Row(i));
+            SquareSums(weights, radius_, i, weight_sums.data());
+            SquareSums(offsets, radius_, i, offset_sums.data());
+            for (size_t x = 0; x < stride; ++x) {
+                double value = (std::ldexp(weight_sums[x] * static_cast<double>(row[x]), -kWeightBits) +
+                                std::ldexp(offset_sums[x], -kOffsetBits)) * inverse;
+                out[x] = static_cast<uint8_t>(std::clamp(value + 0.5, 0.0, 255.0));
+            }
+        }
+    });
+    arena.Release(std::exchange(image.pixel_storage_, std::move(result)));
 }
 
-void
-GaussianBlur::BoxBlur(std::vector<std::vector<Pixel>> &source, std::vector<std::vector<Pixel>> &target, size_t radius) {
-    target = source; // making target and source equally changed after previous BoxBlur funcs applied
-    HorizontalBlur(target, source, radius); // changing source using target as a copy
-    VerticalBlur(source, target, radius); // changing target using source
+FilterKind GuidedFilter::Kind() const {
+    return FilterKind::Stencil;
 }
 
-void GaussianBlur::Apply(Image &image) {
-    std::vector<size_t> boxes = BoxesForGauss(4); // can be > 4, but the result is almost the same
-    auto storage_copy = image.pixel_storage_;
-    BoxBlur(image.pixel_storage_, storage_copy, (boxes[0] - 1) / 2);
-    BoxBlur(storage_copy, image.pixel_storage_, (boxes[1] - 1) / 2);
-    BoxBlur(image.pixel_storage_, storage_copy, (boxes[2] - 1) / 2);
-    BoxBlur(storage_copy, image.pixel_storage_, (boxes[3] - 1) / 2);
-
+size_t GuidedFilter::Halo() const {
+    return 2 * radius_;
 }
 
 // Extra Filters
@@ -275,133 +623,163 @@ void AutoContrast::ContrastNumber(uint8_t &number) {
     }
 }
 
-void AutoContrast::Apply(Image &image) {
-    for (size_t i = 0; i < image.headers_info_.height_; ++i) {
-        for (size_t j = 0; j < image.headers_info_.width_; ++j) {
-            ContrastNumber(image.pixel_storage_[i][j].red);
-            ContrastNumber(image.pixel_storage_[i][j].green);
-            ContrastNumber(image.pixel_storage_[i][j].blue);
-        }
+PointFilter::Table AutoContrast::BuildTable() const {
+    Table table;
+    for (size_t value = 0; value < table.size(); ++value) {
+        uint8_t number = value;
+        ContrastNumber(number);
+        table[value] = number;
     }
+    return table;
 }
 
 Gamma::Gamma(float sigma) : sigma_(sigma) {}
 
-void Gamma::Apply(Image &image) {
-    for (size_t i = 0; i < image.headers_info_.height_; ++i) {
-        for (size_t j = 0; j < image.headers_info_.width_; ++j) {
-
-            image.pixel_storage_[i][j].red = pow(image.pixel_storage_[i][j].red, sigma_);
-            image.pixel_storage_[i][j].green = pow(image.pixel_storage_[i][j].green, sigma_);
-            image.pixel_storage_[i][j].blue = pow(image.pixel_storage_[i][j].blue, sigma_);
-
-        }
+PointFilter::Table Gamma::BuildTable() const { // pow is called 256 times instead of three times per pixel
+    Table table;
+    for (size_t value = 0; value < table.size(); ++value) {
+        uint8_t number = value;
+        table[value] = pow(number, sigma_);
     }
+    return table;
 }
 
 PixelImage::PixelImage(size_t pixel_size) : pixel_size_(pixel_size) {}
 
 void PixelImage::Apply(Image &image) {
-    if (pixel_size_ > image.headers_info_.height_ || pixel_size_ > image.headers_info_.height_) {
+    size_t height = image.headers_info_.height_;
+    size_t width = image.headers_info_.width_;
+    if (pixel_size_ > height || pixel_size_ > width) {
         throw std::runtime_error("Pixel size must be less than image's height and width\n");
     }
-
-    for (size_t i = pixel_size_; i < image.headers_info_.height_ - pixel_size_; i += 2 * pixel_size_ + 1) {
-        for (size_t j = pixel_size_; j < image.headers_info_.width_ - pixel_size_; j += 2 * pixel_size_ + 1) {
-            size_t var_red = 0;
-            size_t var_green = 0;
-            size_t var_blue = 0;
-            for (int fi = i - pixel_size_; fi <= i + pixel_size_; ++fi) {
-                for (int fj = j - pixel_size_; fj <= j + pixel_size_; ++fj) {
-                    var_red += image.pixel_storage_[fi][fj].red;
-                    var_green += image.pixel_storage_[fi][fj].green;
-                    var_blue += image.pixel_storage_[fi][fj].blue;
-                }
-            }
-            if (pixel_size_ != 0) {
-                var_red /= (2 * pixel_size_ + 1) * (2 * pixel_size_ + 1);
-                var_green /= (2 * pixel_size_ + 1) * (2 * pixel_size_ + 1);
-                var_blue /= (2 * pixel_size_ + 1) * (2 * pixel_size_ + 1);
-            }
-            for (int fi = i - pixel_size_; fi <= i + pixel_size_; ++fi) {
-                for (int fj = j - pixel_size_; fj <= j + pixel_size_; ++fj) {
-                    image.pixel_storage_[fi][fj].red = var_red;
-                    image.pixel_storage_[fi][fj].green = var_green;
-                    image.pixel_storage_[fi][fj].blue = var_blue;
+    size_t side = 2 * pixel_size_ + 1; // the image is split into side x side blocks, the last ones may be smaller
+    if (side * side > IntegralImage::kMaxArea) {
+        throw std::runtime_error("Pixel size is too large\n");
+    }
+    IntegralImage integral = image.Integral();
+
+    image.pixel_storage_.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, (height + side - 1) / side, [&image, &integral, side, height, width](size_t begin, size_t end) {
+        for (size_t block_row = begin; block_row < end; ++block_row) {
+            size_t top = block_row * side;
+            size_t bottom = std::min(top + side, height);
+            for (size_t left = 0; left < width; left += side) {
+                size_t right = std::min(left + side, width);
+                size_t area = (bottom - top) * (right - left);
+                auto sums = integral.Sum(top, left, bottom, right);
+                Pixel mean{static_cast<uint8_t>(sums[0] / area), static_cast<uint8_t>(sums[1] / area),
+                           static_cast<uint8_t>(sums[2] / area)};
+                for (size_t i = top; i < bottom; ++i) {
+                    std::fill(image.pixel_storage_.Row(i) + left, image.pixel_storage_.Row(i) + right, mean);
                 }
             }
         }
-    }
+    });
 }
 
-Crystallization::Crystallization(size_t shard_size) : shard_size_(shard_size) {}
+Crystallization::Crystallization(size_t shard_size, std::optional<uint64_t> seed) : shard_size_(shard_size),
+                                                                                    seed_(seed) {}
 
-Crystallization::SquareCenter Crystallization::FindCentralSquares(size_t height, size_t width) {
-    SquareCenter squares_centers;
+Crystallization::Seeds Crystallization::PlaceSeeds(size_t height, size_t width) {
     std::random_device rd;
-    std::mt19937 gen(rd()); // randomizer
+    std::mt19937 gen(seed_ ? *seed_ : rd()); // randomizer
     std::uniform_int_distribution<> dis(0, shard_size_ - 1);
+    Seeds seeds;
+    seeds.reserve(((height + shard_size_ - 1) / shard_size_) * ((width + shard_size_ - 1) / shard_size_));
     for (size_t i = 0; i < height; i += shard_size_) {
         for (size_t j = 0; j < width; j += shard_size_) {
             size_t x = dis(gen);
             size_t y = dis(gen);
-            squares_centers[i / shard_size_][j / shard_size_] = {i + x, j + y};
-            centers_.push_back({i + x, j + y});
+            seeds.push_back({i + x, j + y});
         }
     }
-    return squares_centers;
+    return seeds;
 }
 
-Crystallization::Shards Crystallization::FormShards(size_t height, size_t width) {
-    SquareCenter square_centers = FindCentralSquares(height, width);
-    Shards blocks;
-    for (size_t i = 0; i < height; ++i) {
-        for (size_t j = 0; j < width; ++j) {
-            size_t min_distance = UINT64_MAX;
-            std::pair<size_t, size_t> center;
+std::vector<uint32_t> Crystallization::LabelPixels(const Seeds &seeds, size_t height, size_t width) const {
+    size_t grid_height = (height + shard_size_ - 1) / shard_size_;
+    size_t grid_width = (width + shard_size_ - 1) / shard_size_;
+    std::vector<uint32_t> labels = ScratchArena::Instance().AcquireWords(height * width); // every one is written
+
+    ParallelFor(0, height, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
             size_t sqr_x = i / shard_size_;
-            size_t sqr_y = j / shard_size_;
-            for (int fi = -1; fi <= 1; ++fi) {
-                for (int fj = -1; fj <= 1; ++fj) {
-                    if (sqr_x + fi < height && sqr_y + fj < width &&
-                        sqr_x + fi >= 0 && sqr_y + fj >= 0) {
-                        size_t center_x = square_centers[sqr_x + fi][sqr_y + fj].first;
-                        size_t center_y = square_centers[sqr_x + fi][sqr_y + fj].second;
+            size_t first_x = sqr_x == 0 ? 0 : sqr_x - 1;
+            size_t last_x = std::min(sqr_x + 1, grid_height - 1);
+            for (size_t j = 0; j < width; ++j) {
+                size_t sqr_y = j / shard_size_;
+                size_t first_y = sqr_y == 0 ? 0 : sqr_y - 1;
+                size_t last_y = std::min(sqr_y + 1, grid_width - 1);
+                size_t min_distance = UINT64_MAX;
+                size_t nearest = 0;
+                for (size_t fi = first_x; fi <= last_x; ++fi) {
+                    for (size_t fj = first_y; fj <= last_y; ++fj) {
+                        const auto &[center_x, center_y] = seeds[fi * grid_width + fj];
+                        // unsigned differences wrap around, but their squares are still right modulo 2^64
                         size_t distance = (center_x - i) * (center_x - i) + (center_y - j) * (center_y - j);
                         if (distance < min_distance) {
                             min_distance = distance;
-                            center = {center_x, center_y};
+                            nearest = fi * grid_width + fj;
                         }
                     }
                 }
+                labels[i * width + j] = nearest;
             }
-            blocks[center.first][center.second].push_back({i, j});
         }
-    }
-    return blocks;
+    });
+    return labels;
 }
 
 void Crystallization::Apply(Image &image) {
-    Shards blocks = FormShards(image.headers_info_.height_, image.headers_info_.width_);
-    for (const auto&[center_x, center_y]: centers_) {
-        size_t var_red = 0;
-        size_t var_green = 0;
-        size_t var_blue = 0;
-        for (const auto&[point_x, point_y]: blocks[center_x][center_y]) {
-            var_red += image.pixel_storage_[point_x][point_y].red;
-            var_green += image.pixel_storage_[point_x][point_y].green;
-            var_blue += image.pixel_storage_[point_x][point_y].blue;
-        }
-        if (!blocks[center_x][center_y].empty()) {
-            var_red /= blocks[center_x][center_y].size();
-            var_green /= blocks[center_x][center_y].size();
-            var_blue /= blocks[center_x][center_y].size();
+    if (shard_size_ == 0) {
+        throw std::runtime_error("Shard size must be positive\n");
+    }
+    size_t height = image.headers_info_.height_;
+    size_t width = image.headers_info_.width_;
+    Seeds seeds = PlaceSeeds(height, width);
+    if (seeds.size() > UINT32_MAX) {
+        throw std::runtime_error("Shard size is too small for this image\n");
+    }
+    std::vector<uint32_t> labels = LabelPixels(seeds, height, width);
+
+    struct Shard {
+        size_t red = 0;
+        size_t green = 0;
+        size_t blue = 0;
+        size_t count = 0;
+    };
+    std::vector<Shard> shards(seeds.size());
+    for (size_t i = 0; i < height; ++i) { // one sweep collects the sums of all shards
+        const Pixel *row = std::as_const(image.pixel_storage_).Row(i);
+        const uint32_t *row_labels = labels.data() + i * width;
+        for (size_t j = 0; j < width; ++j) {
+            Shard &shard = shards[row_labels[j]];
+            shard.red += row[j].red;
+            shard.green += row[j].green;
+            shard.blue += row[j].blue;
+            ++shard.count;
         }
+    }
 
-        for (const auto&[point_x, point_y]: blocks[center_x][center_y]) {
-            image.pixel_storage_[point_x][point_y].red = var_red;
-            image.pixel_storage_[point_x][point_y].green = var_green;
-            image.pixel_storage_[point_x][point_y].blue = var_blue;
+    std::vector<Pixel> colors(shards.size());
+    for (size_t index = 0; index < shards.size(); ++index) {
+        const Shard &shard = shards[index];
+        if (shard.count != 0) {
+            colors[index] = Pixel{static_cast<uint8_t>(shard.red / shard.count),
+                                  static_cast<uint8_t>(shard.green / shard.count),
+                                  static_cast<uint8_t>(shard.blue / shard.count)};
         }
     }
+
+    image.pixel_storage_.MakeWritable(); // rows are shared between threads
+    ParallelFor(0, height, [&image, &labels, &colors, width](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Pixel *row = image.pixel_storage_.Row(i);
+            const uint32_t *row_labels = labels.data() + i * width;
+            for (size_t j = 0; j < width; ++j) {
+                row[j] = colors[row_labels[j]];
+            }
+        }
+    });
+    ScratchArena::Instance().Release(std::move(labels));
 }
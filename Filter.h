@@ -2,13 +2,119 @@
 
 #include "ImageParser.h"
 #include "Image.h"
-#include <unordered_map>
+#include "Resample.h"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+enum class FilterKind {
+    Point, // every output pixel depends only on the same input pixel
+    Stencil, // every output pixel depends on a small neighbourhood of the same input pixel
+    Geometric, // moves pixels around without changing them
+    Global // anything else, e.g. needs statistics of the whole image
+};
 
 class Filter {
 public:
+    static constexpr size_t kWholeImage = SIZE_MAX;
+
     virtual void Apply(Image &image) = 0;
 
+    virtual FilterKind Kind() const; // Global unless the filter says otherwise
+
+    // the pixel layout the filter wants the image in, ApplyFilters converts it only when this changes;
+    // Interleaved unless the filter says otherwise
+    virtual PixelLayout Layout() const;
+
+    // number of rows above and below a band the filter needs to produce that band exactly,
+    // kWholeImage if the filter can only be applied to the whole image at once
+    virtual size_t Halo() const;
+
+    void SetLabel(std::string label);
+
+    const std::string &Label() const; // how the filter was asked for, e.g. "-blur 3", shown in profiles
+
     virtual ~Filter() = default;
+
+private:
+    std::string label_;
+};
+
+class RowFilter : public Filter { // point filter that can be applied to any run of pixels of a row
+public:
+    virtual void Prepare(); // called once before the rows are processed, possibly on several threads
+
+    virtual void ApplyRow(Pixel *row, size_t count) const = 0;
+
+    // the same for a run of planar pixels; by default they are interleaved into a temporary row for ApplyRow
+    virtual void ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const;
+
+    void Apply(Image &image) override; // works on either layout
+
+    FilterKind Kind() const override;
+
+    size_t Halo() const override;
+};
+
+class FusedRowFilter : public RowFilter { // several row filters applied to one row after another in a single pass
+public:
+    FusedRowFilter(std::vector<std::shared_ptr<RowFilter>> filters);
+
+    void Append(std::shared_ptr<RowFilter> filter); // neighbouring lookup tables are composed into one
+
+    std::shared_ptr<RowFilter> Single() const; // the only fused filter, nullptr if there are several
+
+    void Prepare() override;
+
+    void ApplyRow(Pixel *row, size_t count) const override;
+
+    void ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const override;
+
+    // planar if some filter wants planar and none interleaved, and the other way round
+    PixelLayout Layout() const override;
+
+private:
+    std::vector<std::shared_ptr<RowFilter>> filters_;
+};
+
+class StencilFilter : public Filter { // local stencil that can pass its output rows through a row filter right away
+public:
+    void SetEpilogue(std::shared_ptr<RowFilter> epilogue);
+
+    FilterKind Kind() const override;
+
+protected:
+    std::shared_ptr<RowFilter> epilogue_;
+};
+
+class PointFilter : public RowFilter { // maps every channel value on its own, so it boils down to a 256-entry table
+public:
+    using Table = std::array<uint8_t, 256>;
+
+    virtual Table BuildTable() const = 0;
+
+    void Prepare() override; // builds the table once, even if several images are filtered at the same time
+
+    void ApplyRow(Pixel *row, size_t count) const override;
+
+    void ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const override;
+
+    PixelLayout Layout() const override; // a table is looked up as fast in planes
+
+private:
+    std::once_flag table_built_;
+    Table table_;
+};
+
+class FusedPointFilter : public PointFilter { // several point filters in a row applied in a single pass
+public:
+    FusedPointFilter(const std::vector<std::shared_ptr<PointFilter>> &filters);
+
+    Table BuildTable() const override;
+
+private:
+    Table table_;
 };
 
 // Basic Filters
@@ -19,86 +125,187 @@ public:
 
     void Apply(Image &image) override;
 
+    FilterKind Kind() const override;
+
+    // cropping twice keeps as much as the smaller of the two crops
+    std::shared_ptr<Crop> Merge(const Crop &other) const;
+
 private:
     size_t width_;
     size_t height_;
 };
 
-class Grayscale : public Filter {
+// -flipv, -fliph, -transpose and -rot90: O(1), the image only records where its pixels have to go
+class Reorientation : public Filter {
 public:
-    Grayscale();
+    Reorientation(Orientation orientation);
+
+    void Apply(Image &image) override;
+
+    FilterKind Kind() const override;
+
+    PixelLayout Layout() const override; // pixels are moved later, in whatever layout they are then
+
+private:
+    Orientation orientation_;
+};
+
+// -resize width height [lanczos|bicubic|box]: separable resampling to a new size (see Resample.h), the alpha of
+// 32-bit images is resampled the same way
+class Resize : public Filter {
+public:
+    Resize(size_t width, size_t height, ResampleMethod method = ResampleMethod::Lanczos);
 
     void Apply(Image &image) override;
+
+private:
+    size_t width_;
+    size_t height_;
+    ResampleMethod method_;
+};
+
+class Grayscale : public RowFilter {
+public:
+    Grayscale();
+
+    void ApplyRow(Pixel *row, size_t count) const override;
+
+    void ApplyPlanarRow(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) const override;
+
+    PixelLayout Layout() const override; // planes need no shuffling to mix the channels
 };
 
-class Negative : public Filter {
+class Negative : public PointFilter {
 public:
     Negative();
 
-    void Apply(Image &image) override;
+    Table BuildTable() const override;
+
+    void ApplyRow(Pixel *row, size_t count) const override; // alone it is cheaper to compute than to look up
 };
 
-class Sharpening : public Filter {
+class Sharpening : public StencilFilter {
 public:
     Sharpening();
 
     void Apply(Image &image) override;
+
+    size_t Halo() const override;
 };
 
-class EdgeDetection : public Filter {
+class EdgeDetection : public StencilFilter {
 public:
     EdgeDetection(float threshold);
 
     void Apply(Image &image) override;
 
+    size_t Halo() const override;
+
 private:
     float threshold_;
 };
 
 class GaussianBlur : public Filter {
-    // Complexity of this filter is O(height * width) for any sigma
+    // Complexity of this filter is O(height * width) for any sigma, integer sums divided by a reciprocal multiply
+    // (see ScaleSums): the same result as dividing exactly for boxes of up to kExactBoxWindow pixels
 public:
     GaussianBlur(float sigma);
 
-    std::vector<size_t> BoxesForGauss(size_t n);
+    std::vector<size_t> BoxesForGauss(size_t n) const;
 
-    void
-    HorizontalBlur(const std::vector<std::vector<Pixel>> &source, std::vector<std::vector<Pixel>> &target,
-                   size_t radius);
+    // rows are blurred one by one, edge pixels repeat outside the image
+    void HorizontalBlur(const ImageBuffer &source, ImageBuffer &target, size_t radius);
 
-    void
-    VerticalBlur(const std::vector<std::vector<Pixel>> &source, std::vector<std::vector<Pixel>> &target, size_t radius);
+    // rows are walked top to bottom with running sums for a strip of columns, so memory is read row by row
+    void VerticalBlur(const ImageBuffer &source, ImageBuffer &target, size_t radius);
 
-    void BoxBlur(std::vector<std::vector<Pixel>> &source, std::vector<std::vector<Pixel>> &target, size_t radius);
+    // source -> temporary -> target, temporary and target are preallocated buffers of the same size as source
+    void BoxBlur(const ImageBuffer &source, ImageBuffer &temporary, ImageBuffer &target, size_t radius);
 
     void Apply(Image &image) override;
 
+    FilterKind Kind() const override;
+
+    size_t Halo() const override;
+
 private:
     float sigma_;
 };
 
+class Convolution : public StencilFilter { // arbitrary odd-sized square kernel, coefficients row by row
+public:
+    Convolution(size_t size, std::vector<double> weights);
+
+    void Apply(Image &image) override;
+
+    size_t Halo() const override;
+
+private:
+    size_t size_;
+    std::vector<double> weights_;
+};
+
+class BoxFilter : public Filter { // mean of the (2 * radius + 1)^2 square around every pixel, O(1) per pixel
+public:
+    BoxFilter(size_t radius);
+
+    void Apply(Image &image) override;
+
+    FilterKind Kind() const override;
+
+    size_t Halo() const override;
+
+private:
+    size_t radius_;
+};
+
+// edge-preserving smoothing (-bilateral): a guided filter with every channel guiding itself, so flat areas get
+// the mean of the (2 * radius + 1)^2 square while differences well above sigma_range are kept; O(1) per pixel
+class GuidedFilter : public Filter {
+    // Means over squares come from summed-area tables (see IntegralImage), so the cost doesn't depend on the radius;
+    // squares sticking out of the image repeat its edge pixels, the same as BoxFilter
+public:
+    // the sums of squared pixels and of the fixed-point a and b over a square of this radius still fit into uint32
+    static constexpr size_t kMaxRadius = 100;
+
+    GuidedFilter(float sigma_spatial, float sigma_range); // radius is sigma_spatial rounded, range is in 0..255
+
+    void Apply(Image &image) override;
+
+    FilterKind Kind() const override;
+
+    size_t Halo() const override; // two box passes in a row
+
+private:
+    static constexpr int kWeightBits = 16; // fractional bits of a
+    static constexpr int kOffsetBits = 8; // of b
+
+    size_t radius_;
+    float epsilon_; // sigma_range^2, variances below it are smoothed away
+};
+
 // Extra Filters
 
-class AutoContrast : public Filter { // speaks for himself
+class AutoContrast : public PointFilter { // speaks for himself
 public:
     AutoContrast();
 
-    void ContrastNumber(uint8_t& number);
+    static void ContrastNumber(uint8_t& number);
 
-    void Apply(Image &image) override;
+    Table BuildTable() const override;
 };
 
-class Gamma : public Filter { // just gamma filter, controls the brightness of picture
+class Gamma : public PointFilter { // just gamma filter, controls the brightness of picture
 public:
     Gamma(float sigma);
 
-    void Apply(Image &image) override;
+    Table BuildTable() const override;
 
 private:
     float sigma_;
 };
 
-class PixelImage : public Filter { // makes an image made of pixels bigger size (pixel blurring)
+class PixelImage : public Filter { // makes an image made of pixels bigger size (pixel blurring), O(height * width)
 public:
     PixelImage(size_t pixel_size);
 
@@ -109,21 +316,20 @@ private:
 };
 
 class Crystallization : public Filter { // crystallize an image
+    // Complexity of this filter is O(height * width), every pixel goes to the nearest of the 9 seeds around it
 public:
+    using Seeds = std::vector<std::pair<size_t, size_t>>; // one random point per shard_size square, row by row
 
-    using SquareCenter = std::unordered_map<size_t, std::unordered_map<size_t, std::pair<size_t, size_t>>>;
-    using Shards = std::unordered_map<size_t, std::unordered_map<size_t, std::vector<std::pair<size_t, size_t>>>>;
-
-    Crystallization(size_t shard_size);
+    Crystallization(size_t shard_size, std::optional<uint64_t> seed = std::nullopt); // random if no seed
 
-    SquareCenter FindCentralSquares(size_t height, size_t width);
+    Seeds PlaceSeeds(size_t height, size_t width);
 
-    Shards FormShards(size_t height, size_t width);
+    // index of the nearest seed for every pixel, row by row
+    std::vector<uint32_t> LabelPixels(const Seeds &seeds, size_t height, size_t width) const;
 
     void Apply(Image &image) override;
 
 private:
     size_t shard_size_;
-    std::vector<std::pair<size_t, size_t>> centers_;
+    std::optional<uint64_t> seed_;
 };
-
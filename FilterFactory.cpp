@@ -1,6 +1,11 @@
 #include "FilterFactory.h"
+#include "FilterPlan.h"
+#include "Profiler.h"
+#include <cstdlib>
 
-std::shared_ptr<Filter> FilterFactory::CreateFilter(const FilterInfo &filter) {
+namespace {
+
+std::shared_ptr<Filter> MakeFilter(const FilterInfo &filter) {
     if (filter.name == "-crop") {
         size_t width = std::stoull(filter.params[0]);
         size_t height = std::stoull(filter.params[1]);
@@ -23,6 +28,23 @@ std::shared_ptr<Filter> FilterFactory::CreateFilter(const FilterInfo &filter) {
         float sigma = std::stof(filter.params[0]);
         return std::make_shared<GaussianBlur>(sigma);
     }
+    if (filter.name == "-conv") {
+        size_t size = std::stoull(filter.params[0]);
+        std::vector<double> weights;
+        for (size_t index = 1; index < filter.params.size(); ++index) {
+            weights.push_back(std::stod(filter.params[index]));
+        }
+        return std::make_shared<Convolution>(size, std::move(weights));
+    }
+    if (filter.name == "-box") {
+        size_t radius = std::stoull(filter.params[0]);
+        return std::make_shared<BoxFilter>(radius);
+    }
+    if (filter.name == "-bilateral") {
+        float sigma_spatial = std::strtof(filter.params[0].c_str(), nullptr);
+        float sigma_range = std::strtof(filter.params[1].c_str(), nullptr); // very large ones become infinity
+        return std::make_shared<GuidedFilter>(sigma_spatial, sigma_range);
+    }
     if (filter.name == "-contr") {
         return std::make_shared<AutoContrast>();
     }
@@ -34,26 +56,70 @@ std::shared_ptr<Filter> FilterFactory::CreateFilter(const FilterInfo &filter) {
         size_t pixel_size = std::stoull(filter.params[0]);
         return std::make_shared<PixelImage>(pixel_size);
     }
+    if (filter.name == "-flipv") {
+        return std::make_shared<Reorientation>(Orientation::FlipVertically());
+    }
+    if (filter.name == "-fliph") {
+        return std::make_shared<Reorientation>(Orientation::FlipHorizontally());
+    }
+    if (filter.name == "-rot90") {
+        return std::make_shared<Reorientation>(Orientation::Rotate90());
+    }
+    if (filter.name == "-transpose") {
+        return std::make_shared<Reorientation>(Orientation::Transpose());
+    }
+    if (filter.name == "-resize") {
+        size_t width = std::stoull(filter.params[0]);
+        size_t height = std::stoull(filter.params[1]);
+        ResampleMethod method = ResampleMethod::Lanczos;
+        if (filter.params.size() > 2 && filter.params[2] == "bicubic") {
+            method = ResampleMethod::Bicubic;
+        } else if (filter.params.size() > 2 && filter.params[2] == "box") {
+            method = ResampleMethod::Box;
+        }
+        return std::make_shared<Resize>(width, height, method);
+    }
     if (filter.name == "-crystal") {
         size_t shard_size = std::stoull(filter.params[0]);
-        return std::make_shared<Crystallization>(shard_size);
+        std::optional<uint64_t> seed;
+        if (filter.params.size() > 1) {
+            seed = std::stoull(filter.params[1]);
+        }
+        return std::make_shared<Crystallization>(shard_size, seed);
     }
     return {};
 }
 
-std::vector<std::shared_ptr<Filter>> FilterFactory::CreateFilters(const std::vector<FilterInfo> &filters) {
-    std::vector<std::shared_ptr<Filter>> created_filters;
-    created_filters.reserve(filters.size());
-    for (const auto &filter: filters) {
-        created_filters.push_back(CreateFilter(filter));
+}
+
+std::shared_ptr<Filter> FilterFactory::CreateFilter(const FilterInfo &filter) {
+    auto created = MakeFilter(filter);
+    if (created) {
+        std::string label = filter.name;
+        for (const auto &param: filter.params) {
+            label += " " + param;
+        }
+        created->SetLabel(std::move(label));
     }
+    return created;
+}
 
-    return created_filters;
+std::vector<std::shared_ptr<Filter>> FilterFactory::CreateFilters(const std::vector<FilterInfo> &filters) {
+    return FilterPlan(filters).Filters();
 }
 
 void FilterFactory::ApplyFilters(Image &image, const std::vector<FilterInfo> &filters) {
-    const auto& created_filters = FilterFactory::CreateFilters(filters);
-    for (const auto &filter: created_filters) {
+    ApplyFilters(image, FilterFactory::CreateFilters(filters));
+}
+
+void FilterFactory::ApplyFilters(Image &image, const std::vector<std::shared_ptr<Filter>> &filters) {
+    for (const auto &filter: filters) {
+        image.SetLayout(filter->Layout());
+        ProfileScope scope("filter", filter->Label(), image.Width() * image.Height() * sizeof(Pixel));
+        if (filter->Kind() != FilterKind::Point && filter->Kind() != FilterKind::Geometric) {
+            image.Materialize(); // a point filter doesn't care where pixels are, geometric ones keep track of it
+        }
         filter->Apply(image);
     }
+    image.Materialize();
 }
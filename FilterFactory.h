@@ -1,3 +1,5 @@
+#pragma once
+
 #include "Filter.h"
 #include <memory>
 
@@ -5,7 +7,10 @@ class FilterFactory {
 public:
     static std::shared_ptr<Filter> CreateFilter(const FilterInfo& filter);
 
+    // the filters of the optimized plan (see FilterPlan), they give the same result as the listed ones
     static std::vector<std::shared_ptr<Filter>> CreateFilters(const std::vector<FilterInfo> &filters);
 
     static void ApplyFilters(Image& image, const std::vector<FilterInfo>& filters);
+
+    static void ApplyFilters(Image& image, const std::vector<std::shared_ptr<Filter>>& filters);
 };
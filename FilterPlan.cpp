@@ -0,0 +1,140 @@
+#include "FilterPlan.h"
+#include "FilterFactory.h"
+#include <sstream>
+#include <utility>
+
+namespace {
+
+const char *KindName(FilterKind kind) {
+    switch (kind) {
+        case FilterKind::Point:
+            return "point";
+        case FilterKind::Stencil:
+            return "stencil";
+        case FilterKind::Geometric:
+            return "geometric";
+        case FilterKind::Global:
+            break;
+    }
+    return "global";
+}
+
+void AppendFilters(std::ostringstream &out, const std::vector<FilterInfo> &filters) {
+    for (size_t index = 0; index < filters.size(); ++index) {
+        out << (index == 0 ? "" : " ") << filters[index].name;
+        for (const auto &param: filters[index].params) {
+            out << ' ' << param;
+        }
+    }
+}
+
+std::string StageName(const PlanStage &stage) { // "stencil: -sharp + point: -neg"
+    std::ostringstream out;
+    out << KindName(stage.kind) << ": ";
+    AppendFilters(out, stage.filters);
+    if (!stage.epilogue.empty()) {
+        out << " + point: ";
+        AppendFilters(out, stage.epilogue);
+    }
+    return out.str();
+}
+
+}
+
+FilterPlan::FilterPlan(const std::vector<FilterInfo> &filters) {
+    for (const auto &info: filters) {
+        auto filter = FilterFactory::CreateFilter(info);
+        stages_.push_back({filter->Kind(), {info}, {}, filter});
+    }
+    MoveCropsForward();
+    FusePointFilters();
+    FuseEpilogues();
+    for (const auto &stage: stages_) { // profiles name the stages the way Describe does
+        stage.filter->SetLabel(StageName(stage));
+    }
+}
+
+const std::vector<PlanStage> &FilterPlan::Stages() const {
+    return stages_;
+}
+
+std::vector<std::shared_ptr<Filter>> FilterPlan::Filters() const {
+    std::vector<std::shared_ptr<Filter>> filters;
+    filters.reserve(stages_.size());
+    for (const auto &stage: stages_) {
+        filters.push_back(stage.filter);
+    }
+    return filters;
+}
+
+std::string FilterPlan::Describe() const {
+    std::ostringstream out;
+    for (size_t index = 0; index < stages_.size(); ++index) {
+        out << index + 1 << ". " << StageName(stages_[index]) << '\n';
+    }
+    return out.str();
+}
+
+void FilterPlan::MoveCropsForward() {
+    // point filters do not care where a pixel is, so cropping first gives the same pixels with less work
+    for (size_t index = 0; index < stages_.size(); ++index) {
+        if (stages_[index].kind != FilterKind::Geometric || !std::dynamic_pointer_cast<Crop>(stages_[index].filter)) {
+            continue;
+        }
+        size_t position = index;
+        while (position > 0 && stages_[position - 1].kind == FilterKind::Point) {
+            std::swap(stages_[position - 1], stages_[position]);
+            --position;
+        }
+        if (position > 0) {
+            auto &previous = stages_[position - 1];
+            if (auto previous_crop = std::dynamic_pointer_cast<Crop>(previous.filter)) {
+                previous.filter = previous_crop->Merge(static_cast<const Crop &>(*stages_[position].filter));
+                previous.filters.push_back(stages_[position].filters.front());
+                stages_.erase(stages_.begin() + static_cast<ptrdiff_t>(position));
+            }
+        }
+    }
+}
+
+void FilterPlan::FusePointFilters() {
+    std::vector<PlanStage> fused;
+    for (auto &stage: stages_) {
+        if (stage.kind != FilterKind::Point || fused.empty() || fused.back().kind != FilterKind::Point) {
+            fused.push_back(std::move(stage));
+            continue;
+        }
+        auto &run = fused.back();
+        run.filters.push_back(stage.filters.front());
+        auto run_filter = std::dynamic_pointer_cast<FusedRowFilter>(run.filter);
+        if (!run_filter) {
+            run_filter = std::make_shared<FusedRowFilter>(
+                    std::vector<std::shared_ptr<RowFilter>>{std::static_pointer_cast<RowFilter>(run.filter)});
+            run.filter = run_filter;
+        }
+        run_filter->Append(std::static_pointer_cast<RowFilter>(stage.filter));
+    }
+    for (auto &stage: fused) { // a run that became a single lookup table does not need the wrapper
+        if (auto run_filter = std::dynamic_pointer_cast<FusedRowFilter>(stage.filter)) {
+            if (auto single = run_filter->Single()) {
+                stage.filter = single;
+            }
+        }
+    }
+    stages_ = std::move(fused);
+}
+
+void FilterPlan::FuseEpilogues() {
+    std::vector<PlanStage> fused;
+    for (auto &stage: stages_) {
+        if (stage.kind == FilterKind::Point && !fused.empty() && fused.back().epilogue.empty()) {
+            if (auto stencil = std::dynamic_pointer_cast<StencilFilter>(fused.back().filter)) {
+                stencil->SetEpilogue(std::static_pointer_cast<RowFilter>(stage.filter));
+                fused.back().epilogue = std::move(stage.filters);
+                continue;
+            }
+        }
+        fused.push_back(std::move(stage));
+    }
+    stages_ = std::move(fused);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Filter.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PlanStage { // one trip through the pixels
+    FilterKind kind;
+    std::vector<FilterInfo> filters; // the filters from the command line this stage does, in their order
+    std::vector<FilterInfo> epilogue; // point filters done on the output rows of a stencil in the same pass
+    std::shared_ptr<Filter> filter;
+};
+
+// Execution plan for a chain of filters. Consecutive point filters are fused into one pass (with their lookup
+// tables composed into one), point filters right after a stencil are applied to its output rows on the fly,
+// crops are merged and moved ahead of point filters, so they work on fewer pixels. The result is always the same
+// as applying the filters one by one.
+class FilterPlan {
+public:
+    FilterPlan(const std::vector<FilterInfo> &filters);
+
+    const std::vector<PlanStage> &Stages() const;
+
+    std::vector<std::shared_ptr<Filter>> Filters() const;
+
+    std::string Describe() const; // one line per stage, e.g. "2. stencil: -sharp + point: -neg -gamma 0.8"
+
+private:
+    void MoveCropsForward();
+
+    void FusePointFilters();
+
+    void FuseEpilogues();
+
+    std::vector<PlanStage> stages_;
+};
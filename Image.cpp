@@ -1,69 +1,175 @@
 #include "Image.h"
-#include <fstream>
+#include "BMPReader.h"
+#include "BMPWriter.h"
+#include "MappedFile.h"
+#include "PixelKernels.h"
+#include "Profiler.h"
+#include "Rle.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+Image::Image(const std::string &file_name, ReadMode mode) : file_name_(file_name) {
+    Read(file_name, mode);
+}
 
+Image::Image(const BMPHeaders &headers, ImageBuffer pixels) : headers_info_(headers),
+                                                              pixel_storage_(std::move(pixels)) {
+    headers_info_.height_ = pixel_storage_.Height();
+    headers_info_.width_ = pixel_storage_.Width();
+}
 
-Image::Image(const std::string &file_name) : file_name_(file_name) {
-    Read(file_name);
+Image::~Image() {
+    ScratchArena::Instance().Release(std::move(pixel_storage_));
 }
 
-void Image::Read(const std::string &input_file) {
-    std::ifstream input;
-    input.open(input_file, std::ios::binary);
+PixelLayout Image::Layout() const {
+    return layout_;
+}
 
-    if (!input.is_open()) {
-        throw std::runtime_error("Cannot open input file\n");
+void Image::SetLayout(PixelLayout layout) {
+    if (layout == PixelLayout::Any || layout == layout_) {
+        return;
     }
-
-    input.read(reinterpret_cast<char *>(&headers_info_), sizeof(headers_info_));
-
-    if (headers_info_.file_type != 0x4D42) {
-        input.close();
-        throw std::runtime_error("The only supported file format is BMP\n");
+    ScratchArena &arena = ScratchArena::Instance();
+    if (layout == PixelLayout::Planar) {
+        planes_ = PlanarBuffer::Split(pixel_storage_);
+        arena.Release(std::exchange(pixel_storage_, ImageBuffer()));
+    } else {
+        pixel_storage_ = planes_.Merge();
+        planes_.Clear();
     }
+    layout_ = layout;
+}
 
-    if (headers_info_.bits_per_pixel != 24) {
-        input.close();
-        throw std::runtime_error("The number of bits per pixel has to be 24\n");
+void Image::Materialize() {
+    if (orientation_.IsIdentity()) {
+        return;
+    }
+    ProfileScope scope("filter", "materialize", headers_info_.height_ * headers_info_.width_ * sizeof(Pixel));
+    if (layout_ == PixelLayout::Planar) {
+        planes_ = Orient(planes_, orientation_);
+    } else {
+        pixel_storage_ = Orient(std::move(pixel_storage_), orientation_);
     }
+    if (!alpha_.Empty()) {
+        alpha_ = Orient(alpha_, orientation_);
+    }
+    orientation_ = Orientation();
+}
 
-    if (headers_info_.DIBHeader_size != 40) {
-        input.close();
-        throw std::runtime_error("DIB header size must be 40 bits. Check your file format");
+void Image::Read(const std::string &input_file, ReadMode mode) {
+    ProfileScope scope("read", input_file);
+    planes_.Clear();
+    orientation_ = Orientation();
+    layout_ = PixelLayout::Interleaved; // files are interleaved, planes are made when a filter asks for them
+    if (mode == ReadMode::Mapped) {
+        ReadMapped(input_file);
+    } else {
+        ReadStream(input_file);
     }
+    if (mode == ReadMode::Stream) { // mapped pages are read later by the first filter that touches them
+        scope.AddBytes(pixel_storage_.Height() * pixel_storage_.Stride());
+    }
+}
 
-    uint32_t length = headers_info_.width_ * headers_info_.bits_per_pixel / 8;
-    uint8_t padding_amount = (4 - length % 4) % 4;
-    unsigned char color[3];
+void Image::ReadStream(const std::string &input_file) {
+    BMPReader reader(input_file);
+    headers_info_ = reader.Headers();
+    format_ = reader.Format();
+    alpha_ = format_.HasAlpha() ? PlanarBuffer(headers_info_.height_, headers_info_.width_, 1) : PlanarBuffer();
+    ScratchArena &arena = ScratchArena::Instance();
+    arena.Release(std::exchange(pixel_storage_, arena.Acquire(headers_info_.height_, headers_info_.width_)));
+    reader.ReadRows(0, headers_info_.height_, pixel_storage_, 0, &alpha_);
+}
 
-    pixel_storage_.resize(headers_info_.height_);
+void Image::ReadMapped(const std::string &input_file) {
+    auto file = std::make_shared<const MappedFile>(input_file);
 
-    for (size_t i = 0; i < headers_info_.height_; ++i) {
-        for (size_t j = 0; j < headers_info_.width_; ++j) {
-            input.read(reinterpret_cast<char *>(color), 3);
-            pixel_storage_[i].push_back(Pixel{color[0], color[1], color[2]});
+    if (file->Size() < sizeof(headers_info_)) {
+        throw std::runtime_error("The only supported file format is BMP\n");
+    }
+    std::memcpy(&headers_info_, file->Data(), sizeof(headers_info_));
+    CheckHeaders(headers_info_);
+    format_ = ReadFormat(headers_info_, file->Data(), file->Size());
+    RowOrder order = TakeRowOrder(headers_info_);
+
+    size_t stride = format_.Stride(headers_info_.width_);
+    size_t height = headers_info_.height_;
+    size_t width = headers_info_.width_;
+    if (headers_info_.offset > file->Size() || (!format_.IsCompressed() && stride != 0 &&
+        (file->Size() - headers_info_.offset) / stride < height)) { // rows of an image 0 pixels wide take no bytes
+        throw std::runtime_error("Unexpected end of file while reading pixels\n");
+    }
+
+    const uint8_t *pixels = file->Data() + headers_info_.offset;
+    alpha_ = format_.HasAlpha() ? PlanarBuffer(height, width, 1) : PlanarBuffer();
+    if (format_.BitsPerPixel() == 24) { // padded BGR rows of the file are used as image rows as they are, in any order
+        pixel_storage_ = ImageBuffer::Borrow(std::move(file), pixels, height, width, stride, order);
+        return;
+    }
+    ScratchArena &arena = ScratchArena::Instance();
+    arena.Release(std::exchange(pixel_storage_, arena.Acquire(height, width)));
+    if (format_.IsCompressed()) { // where a row starts is known only once the previous one is decoded
+        RleDecoder decoder(format_.BitsPerPixel(), width);
+        std::vector<uint8_t> indices(width);
+        size_t size = file->Size() - headers_info_.offset;
+        size_t position = 0;
+        for (size_t i = 0; i < height; ++i) {
+            auto used = decoder.DecodeRow(pixels + position, size - position, indices.data());
+            if (!used) {
+                throw std::runtime_error("Unexpected end of file while reading pixels\n");
+            }
+            position += *used;
+            format_.IndexedRow(indices.data(), width, pixel_storage_.Row(i));
         }
-        input.ignore(padding_amount);
+        return;
     }
-    input.close();
+    ParallelFor(0, height, [&](size_t begin, size_t end) { // other formats are decoded right from the mapping
+        for (size_t i = begin; i < end; ++i) {
+            uint8_t *alpha = alpha_.Empty() ? nullptr : alpha_.Row(0, i);
+            size_t file_row = order == RowOrder::TopDown ? height - 1 - i : i;
+            format_.DecodeRow(pixels + file_row * stride, width, pixel_storage_.Row(i), alpha);
+        }
+    });
 }
 
-void Image::Write(const std::string &output_file) {
-    std::ofstream output;
-    output.open(output_file, std::ios::binary);
-
-    if (!output.is_open()) {
-        throw std::runtime_error("Cannot open output file");
+void Image::Write(const std::string &output_file, WriteMode mode, Compression compression) const {
+    if (!orientation_.IsIdentity()) { // ApplyFilters leaves images materialized, so this is rare
+        Image materialized = *this;
+        materialized.Materialize();
+        materialized.Write(output_file, mode, compression);
+        return;
+    }
+    ProfileScope scope("write", output_file, headers_info_.height_ * headers_info_.width_ * sizeof(Pixel));
+    BMPWriter writer(output_file, headers_info_, format_.Output(compression), mode);
+    if (layout_ == PixelLayout::Planar) { // interleaved on the way out, a row at a time
+        std::vector<Pixel> row(headers_info_.width_);
+        for (size_t i = 0; i < planes_.Height(); ++i) {
+            MergeRow(planes_.Row(0, i), planes_.Row(1, i), planes_.Row(2, i), row.size(), row.data());
+            writer.WriteRow(row.data(), alpha_.Empty() ? nullptr : alpha_.Row(0, i));
+        }
+    } else {
+        writer.WriteRows(pixel_storage_, &alpha_);
     }
+    writer.Close();
+}
 
-    output.write(reinterpret_cast<char *>(&headers_info_), sizeof(headers_info_));
+size_t Image::Width() const {
+    return headers_info_.width_;
+}
 
-    uint32_t length = headers_info_.width_ * headers_info_.bits_per_pixel / 8;
-    uint8_t padding_amount = (4 - length % 4) % 4;
-    unsigned char padding_chars[] = {0, 0, 0};
+size_t Image::Height() const {
+    return headers_info_.height_;
+}
 
-    for (size_t index = 0; index < headers_info_.height_; ++index) {
-        output.write(reinterpret_cast<char *>(pixel_storage_[index].data()), length);
-        output.write(reinterpret_cast<char *>(padding_chars), padding_amount);
-    }
-    output.close();
-}
\ No newline at end of file
+const ImageBuffer &Image::Pixels() const {
+    return pixel_storage_;
+}
+
+IntegralImage Image::Integral() const {
+    return IntegralImage(pixel_storage_);
+}
@@ -1,16 +1,27 @@
-#include "BMPstruct.h"
+#pragma once
+
+#include "BMPWriter.h"
+#include "ImageBuffer.h"
+#include "IntegralImage.h"
+#include "Orientation.h"
+#include "PlanarBuffer.h"
 #include <vector>
 #include <string>
 
+enum class ReadMode {
+    Stream, // reads the pixels into an own buffer
+    Mapped, // maps the file into memory, pixels are copied only when a filter first changes them
+};
+
 class Image {
 public:
-    friend void Apply3x3Matrix(Image &image, const std::vector<std::vector<double>>& matrix);
+    friend class RowFilter;
 
     friend class Crop;
 
-    friend class Grayscale;
+    friend class Reorientation;
 
-    friend class Negative;
+    friend class Resize;
 
     friend class Sharpening;
 
@@ -18,22 +29,66 @@ public:
 
     friend class GaussianBlur;
 
-    friend class AutoContrast;
+    friend class Convolution;
 
-    friend class Gamma;
+    friend class BoxFilter;
+
+    friend class GuidedFilter;
 
     friend class PixelImage;
 
     friend class Crystallization;
 
-    Image(const std::string &file_name);
+    friend class BandPipeline;
+
+    Image(const std::string &file_name, ReadMode mode = ReadMode::Mapped);
+
+    Image(const BMPHeaders &headers, ImageBuffer pixels); // width and height are taken from the pixels
+
+    Image(const Image &other) = default;
+
+    Image(Image &&other) noexcept = default;
+
+    Image &operator=(const Image &other) = default;
+
+    Image &operator=(Image &&other) noexcept = default;
 
-    void Read(const std::string &input_file);
+    ~Image(); // own pixels go back to the scratch arena for the next image
 
-    void Write(const std::string &output_file);
+    void Read(const std::string &input_file, ReadMode mode = ReadMode::Mapped);
+
+    // the image is written in the format it was read in (see BMPFormat::Output)
+    void Write(const std::string &output_file, WriteMode mode = WriteMode::Buffered,
+               Compression compression = Compression::None) const;
+
+    PixelLayout Layout() const;
+
+    // converts the pixels if the image is in another layout; Any leaves them as they are
+    void SetLayout(PixelLayout layout);
+
+    // moves the pixels where pending flips and transposes put them (see Orientation), so rows of the buffers are
+    // rows of the image again; only point and geometric filters work on an image that isn't materialized
+    void Materialize();
+
+    size_t Width() const;
+
+    size_t Height() const;
+
+    const ImageBuffer &Pixels() const; // interleaved only, rows are rows of the image once it is materialized
+
+    IntegralImage Integral() const; // summed-area table of the current pixels, O(height * width), interleaved only
 
 private:
+    void ReadStream(const std::string &input_file);
+
+    void ReadMapped(const std::string &input_file);
+
     std::string file_name_; // optional parameter, never to be used
     BMPHeaders headers_info_;
-    std::vector<std::vector<Pixel>> pixel_storage_;
+    BMPFormat format_; // of the file the image was read from, it is written back in the same one
+    PlanarBuffer alpha_; // the fourth bytes of 32-bit images, rows as in pixel_storage_; empty for other formats
+    Orientation orientation_; // of the buffers below and alpha_, width and height in headers_info_ are the image's
+    PixelLayout layout_ = PixelLayout::Interleaved; // which one of the two below holds the pixels
+    ImageBuffer pixel_storage_;
+    PlanarBuffer planes_;
 };
@@ -0,0 +1,233 @@
+#include "ImageBuffer.h"
+#include "Profiler.h"
+#include "ScratchArena.h"
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace {
+
+uint8_t *AllocatePixels(size_t bytes) {
+    Profiler::CountAllocation(bytes);
+    return static_cast<uint8_t *>(::operator new[](bytes, std::align_val_t{ImageBuffer::kAlignment}));
+}
+
+}
+
+void ImageBuffer::AlignedDeleter::operator()(uint8_t *ptr) const {
+    ::operator delete[](ptr, std::align_val_t{kAlignment});
+}
+
+ImageBuffer::ImageBuffer() : height_(0), width_(0), stride_(0), step_(0), view_(false), capacity_(0),
+                             pixels_(nullptr) {}
+
+ImageBuffer::ImageBuffer(size_t height, size_t width, size_t row_alignment) : height_(height), width_(width),
+                                                                              view_(false), capacity_(0),
+                                                                              pixels_(nullptr) {
+    size_t length = width * sizeof(Pixel);
+    stride_ = (length + row_alignment - 1) / row_alignment * row_alignment;
+    step_ = static_cast<ptrdiff_t>(stride_);
+
+    if (height_ * stride_ == 0) {
+        return;
+    }
+    capacity_ = height_ * stride_;
+    data_.reset(AllocatePixels(capacity_));
+    pixels_ = data_.get();
+    ZeroPadding();
+}
+
+ImageBuffer::ImageBuffer(const ImageBuffer &other) : height_(other.height_), width_(other.width_),
+                                                     stride_(other.stride_), step_(other.step_), view_(other.view_),
+                                                     capacity_(0), pixels_(other.pixels_), owner_(other.owner_) {
+    if (other.data_ && other.view_) { // a copy of an own view gets only the rows it sees, in order
+        ImageBuffer copy(height_, width_);
+        for (size_t i = 0; i < height_; ++i) {
+            std::memcpy(copy.Row(i), other.Row(i), width_ * sizeof(Pixel));
+        }
+        Swap(copy);
+    } else if (other.data_) { // copies of borrowed buffers keep borrowing, so only own pixels are duplicated
+        capacity_ = height_ * stride_;
+        data_.reset(AllocatePixels(capacity_));
+        std::memcpy(data_.get(), other.data_.get(), height_ * stride_);
+        pixels_ = data_.get();
+    }
+}
+
+ImageBuffer::ImageBuffer(ImageBuffer &&other) noexcept: height_(std::exchange(other.height_, 0)),
+                                                         width_(std::exchange(other.width_, 0)),
+                                                         stride_(std::exchange(other.stride_, 0)),
+                                                         step_(std::exchange(other.step_, 0)),
+                                                         view_(std::exchange(other.view_, false)),
+                                                         capacity_(std::exchange(other.capacity_, 0)),
+                                                         data_(std::move(other.data_)),
+                                                         pixels_(std::exchange(other.pixels_, nullptr)),
+                                                         owner_(std::move(other.owner_)) {}
+
+ImageBuffer &ImageBuffer::operator=(const ImageBuffer &other) {
+    if (this != &other) {
+        if (data_ && other.data_ && !view_ && !other.view_ &&
+            height_ * stride_ == other.height_ * other.stride_) { // reuse the allocation
+            height_ = other.height_;
+            width_ = other.width_;
+            stride_ = other.stride_;
+            step_ = other.step_; // the same as the stride, neither of them is a view
+            pixels_ = data_.get();
+            std::memcpy(data_.get(), other.data_.get(), height_ * stride_);
+        } else {
+            ImageBuffer copy(other);
+            Swap(copy);
+        }
+    }
+    return *this;
+}
+
+ImageBuffer &ImageBuffer::operator=(ImageBuffer &&other) noexcept {
+    ImageBuffer moved(std::move(other));
+    Swap(moved);
+    return *this;
+}
+
+ImageBuffer ImageBuffer::Borrow(std::shared_ptr<const void> owner, const uint8_t *data, size_t height, size_t width,
+                                size_t stride, RowOrder order) {
+    ImageBuffer buffer;
+    buffer.height_ = height;
+    buffer.width_ = width;
+    buffer.stride_ = stride;
+    buffer.step_ = static_cast<ptrdiff_t>(stride);
+    buffer.pixels_ = data;
+    buffer.owner_ = std::move(owner);
+    if (order == RowOrder::TopDown && height > 0) { // row 0 is the last one in memory
+        buffer.step_ = -buffer.step_;
+        buffer.pixels_ = data + (height - 1) * stride;
+        buffer.view_ = true;
+    }
+    return buffer;
+}
+
+ImageBuffer ImageBuffer::View(size_t first_row, size_t first_column, size_t height, size_t width) && {
+    ImageBuffer view(std::move(*this));
+    if (height == 0 || width == 0) {
+        return {};
+    }
+    view.view_ = view.view_ || first_row != 0 || first_column != 0 || height != view.height_ || width != view.width_;
+    view.pixels_ += static_cast<ptrdiff_t>(first_row) * view.step_ + first_column * sizeof(Pixel);
+    view.height_ = height;
+    view.width_ = width;
+    return view;
+}
+
+ImageBuffer ImageBuffer::Reversed() && {
+    ImageBuffer reversed(std::move(*this));
+    if (reversed.height_ > 0) {
+        reversed.pixels_ += static_cast<ptrdiff_t>(reversed.height_ - 1) * reversed.step_;
+        reversed.step_ = -reversed.step_;
+        reversed.view_ = true;
+    }
+    return reversed;
+}
+
+bool ImageBuffer::IsBorrowed() const {
+    return owner_ != nullptr;
+}
+
+bool ImageBuffer::IsView() const {
+    return view_;
+}
+
+void ImageBuffer::MakeWritable() {
+    if (!owner_) {
+        return;
+    }
+    ImageBuffer copy = ScratchArena::Instance().Acquire(height_, width_); // bottom-up, whatever order the rows had
+    for (size_t i = 0; i < height_; ++i) {
+        std::memcpy(copy.data_.get() + i * copy.stride_, pixels_ + static_cast<ptrdiff_t>(i) * step_,
+                    width_ * sizeof(Pixel));
+    }
+    Swap(copy); // the borrowed rows go away with copy
+
+}
+
+size_t ImageBuffer::Height() const {
+    return height_;
+}
+
+size_t ImageBuffer::Width() const {
+    return width_;
+}
+
+size_t ImageBuffer::Stride() const {
+    return stride_;
+}
+
+size_t ImageBuffer::SizeBytes() const {
+    return height_ * stride_;
+}
+
+size_t ImageBuffer::Capacity() const {
+    return capacity_;
+}
+
+void ImageBuffer::Reshape(size_t height, size_t width) {
+    height_ = height;
+    width_ = width;
+    stride_ = (width * sizeof(Pixel) + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+    step_ = static_cast<ptrdiff_t>(stride_);
+    view_ = false;
+    pixels_ = data_.get();
+    ZeroPadding();
+}
+
+bool ImageBuffer::Empty() const {
+    return height_ == 0 || width_ == 0;
+}
+
+uint8_t *ImageBuffer::Data() {
+    MakeWritable();
+    return const_cast<uint8_t *>(pixels_); // own pixels after MakeWritable
+}
+
+const uint8_t *ImageBuffer::Data() const {
+    return pixels_;
+}
+
+Pixel *ImageBuffer::Row(size_t index) {
+    if (owner_) { // copy-on-write
+        MakeWritable();
+    }
+    return reinterpret_cast<Pixel *>(const_cast<uint8_t *>(pixels_) + static_cast<ptrdiff_t>(index) * step_);
+}
+
+const Pixel *ImageBuffer::Row(size_t index) const {
+    return reinterpret_cast<const Pixel *>(pixels_ + static_cast<ptrdiff_t>(index) * step_);
+}
+
+std::span<Pixel> ImageBuffer::operator[](size_t index) {
+    return {Row(index), width_};
+}
+
+std::span<const Pixel> ImageBuffer::operator[](size_t index) const {
+    return {Row(index), width_};
+}
+
+void ImageBuffer::Swap(ImageBuffer &other) noexcept {
+    std::swap(height_, other.height_);
+    std::swap(width_, other.width_);
+    std::swap(stride_, other.stride_);
+    std::swap(step_, other.step_);
+    std::swap(view_, other.view_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(data_, other.data_);
+    std::swap(pixels_, other.pixels_);
+    std::swap(owner_, other.owner_);
+}
+
+void ImageBuffer::ZeroPadding() {
+    size_t length = width_ * sizeof(Pixel);
+    if (stride_ == length) {
+        return;
+    }
+    for (size_t i = 0; i < height_; ++i) { // padding bytes are written out as they are, so keep them zeroed
+        std::memset(data_.get() + i * stride_ + length, 0, stride_ - length);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "BMPstruct.h"
+#include <cstddef>
+#include <memory>
+#include <span>
+
+enum class RowOrder {
+    BottomUp, // row 0 is the bottom one, as in most BMP files and in every buffer filters get
+    TopDown, // row 0 is the top one, as in BMP files with a negative height
+};
+
+class ImageBuffer { // one contiguous allocation for the whole pixel matrix
+public:
+    static constexpr size_t kAlignment = 64; // alignment of the first row (cache line)
+    static constexpr size_t kRowAlignment = 4; // the same row padding as in BMP files
+
+    ImageBuffer();
+
+    ImageBuffer(size_t height, size_t width, size_t row_alignment = kRowAlignment);
+
+    ImageBuffer(const ImageBuffer &other);
+
+    ImageBuffer(ImageBuffer &&other) noexcept;
+
+    ImageBuffer &operator=(const ImageBuffer &other);
+
+    ImageBuffer &operator=(ImageBuffer &&other) noexcept;
+
+    // wraps pixels owned by someone else (e.g. a mapped file) without copying them,
+    // they are copied into an own allocation only when the buffer is first accessed for writing;
+    // data holds the rows in the given order, the buffer numbers them bottom-up either way
+    static ImageBuffer Borrow(std::shared_ptr<const void> owner, const uint8_t *data, size_t height, size_t width,
+                              size_t stride, RowOrder order = RowOrder::BottomUp);
+
+    // pixels [first_column, first_column + width) of rows [first_row, first_row + height), in O(1): the pixels stay
+    // where they are and the view keeps using the allocation (or the borrowed memory) of this buffer
+    ImageBuffer View(size_t first_row, size_t first_column, size_t height, size_t width) &&;
+
+    ImageBuffer Reversed() &&; // the same rows in the opposite order, in O(1) as well
+
+    bool IsBorrowed() const;
+
+    bool IsView() const; // made by View, Reversed or reading rows top-down
+
+    void MakeWritable();
+
+    size_t Height() const;
+
+    size_t Width() const;
+
+    size_t Stride() const; // distance between two neighbouring rows in bytes, Row(i + 1) may be before Row(i) in views
+
+    size_t SizeBytes() const;
+
+    size_t Capacity() const; // bytes of the own allocation, at least SizeBytes(); 0 for borrowed buffers
+
+    // height x width pixels with the default row alignment from the start of the own allocation, which has to be
+    // large enough (Capacity()), also for views; pixels are left as they are, padding bytes are zeroed
+    void Reshape(size_t height, size_t width);
+
+    bool Empty() const;
+
+    uint8_t *Data(); // row 0, rows follow it at Stride() unless the buffer is a view
+
+    const uint8_t *Data() const;
+
+    Pixel *Row(size_t index);
+
+    const Pixel *Row(size_t index) const;
+
+    std::span<Pixel> operator[](size_t index);
+
+    std::span<const Pixel> operator[](size_t index) const;
+
+    void Swap(ImageBuffer &other) noexcept;
+
+private:
+    struct AlignedDeleter {
+        void operator()(uint8_t *ptr) const;
+    };
+
+    void ZeroPadding(); // of an own bottom-up allocation
+
+    size_t height_;
+    size_t width_;
+    size_t stride_;
+    ptrdiff_t step_; // from a row to the next one, -stride_ if they are stored top-down
+    bool view_;
+    size_t capacity_; // of data_
+    std::unique_ptr<uint8_t[], AlignedDeleter> data_;
+    const uint8_t *pixels_; // row 0, either in data_ or in borrowed memory
+    std::shared_ptr<const void> owner_; // keeps borrowed memory alive, empty for own allocations
+};
@@ -1,4 +1,8 @@
 #include "ImageParser.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
 #include <stdexcept>
 #include <iostream>
 
@@ -12,17 +16,241 @@ bool IsFloat(const std::string &str) {
     return (*ptr) == '\0';
 }
 
+bool IsNumberStart(char symbol) {
+    return std::isdigit(static_cast<unsigned char>(symbol)) || symbol == '.';
+}
+
 bool FilterInfo::operator==(const FilterInfo &other) const {
     return std::tie(name, params) == std::tie(other.name, other.params);
 }
 
 bool ParserResults::operator==(const ParserResults &other) const {
-    return std::tie(input_file_path, output_file_path, filters) ==
-           std::tie(other.input_file_path, other.output_file_path, other.filters);
+    return std::tie(input_file_path, output_file_path, filters, threads, print_plan, batch_manifest, input_dir,
+                    output_dir, jobs, profile_file, compression) ==
+           std::tie(other.input_file_path, other.output_file_path, other.filters, other.threads, other.print_plan,
+                    other.batch_manifest, other.input_dir, other.output_dir, other.jobs, other.profile_file,
+                    other.compression);
+}
+
+bool ParserResults::IsBatch() const {
+    return !batch_manifest.empty() || !input_dir.empty();
+}
+
+std::string OptionValue(int argc, const char *argv[], int index, const std::string &what) {
+    if (index + 1 == argc || argv[index + 1][0] == '\0') {
+        throw std::runtime_error(std::string(argv[index]) + " option needs " + what + "\n");
+    }
+    return argv[index + 1];
+}
+
+ParserResults ParseFilters(const ParserResults &options, int argc, const char *argv[], int first) {
+    ParserResults results = options;
+    int filter_index = -1;
+    FilterInfo empty_filter{"", {}};
+    for (int index = first; index < argc; ++index) {
+        if (argv[index][0] == '-' && !IsNumberStart(argv[index][1])) { // "-1" is a negative parameter
+            ++filter_index;
+            results.filters.push_back(empty_filter);
+            results.filters[filter_index].name = argv[index];
+        } else {
+            if (filter_index == -1) {
+                throw std::runtime_error("You haven't passed the name of the filter\n");
+            }
+            results.filters[filter_index].params.push_back(argv[index]);
+        }
+    }
+
+    for (const auto &filter : results.filters) {
+        if (filter.name == "-crop") {
+            if (filter.params.size() != 2) {
+                throw std::runtime_error("Crop filter has 2 parameters: width and height\n");
+            } else if (!IsAllDigits(filter.params[0]) || !IsAllDigits(filter.params[1])) {
+                throw std::runtime_error("Crop filter parameters (width and height) must be integers\n");
+            }
+        } else if (filter.name == "-gs") {
+            if (!filter.params.empty()) {
+                throw std::runtime_error("Grayscale filter doesn't have any parameters\n");
+            }
+        } else if (filter.name == "-neg") {
+            if (!filter.params.empty()) {
+                throw std::runtime_error("Negative filter doesn't have any parameters\n");
+            }
+        } else if (filter.name == "-sharp") {
+            if (!filter.params.empty()) {
+                throw std::runtime_error("Sharpening filter doesn't have any parameters\n");
+            }
+        } else if (filter.name == "-edge") {
+            if (filter.params.size() != 1) {
+                throw std::runtime_error("Edge Detection filter needs 1 parameter: threshold\n");
+            } else if (!IsFloat(filter.params[0])) {
+                throw std::runtime_error("Edge Detection filter parameter (threshold) must be a float number\n");
+            } else if (std::stof(filter.params[0]) > 1 || std::stof(filter.params[0]) < 0.0) {
+                throw std::runtime_error("Threshold must be between 0.0 and 1.0\n");
+            }
+        } else if (filter.name == "-blur") {
+            if (filter.params.size() != 1) {
+                throw std::runtime_error("Gaussian Blur filter has only 1 parameter: sigma\n");
+            } else if (!IsFloat(filter.params[0])) {
+                throw std::runtime_error("Sigma parameter must be a float number\n");
+            }
+        } else if (filter.name == "-conv") {
+            if (filter.params.empty() || !IsAllDigits(filter.params[0]) || filter.params[0].empty()) {
+                throw std::runtime_error("Convolution filter needs the kernel size and its coefficients\n");
+            }
+            size_t size = std::stoull(filter.params[0]);
+            if (size % 2 == 0) {
+                throw std::runtime_error("Convolution kernel size must be odd\n");
+            } else if (filter.params.size() != size * size + 1) {
+                throw std::runtime_error("Convolution filter needs size * size coefficients\n");
+            }
+            // the coefficients are applied in 1/4096 fixed point with 32-bit sums (see ConvolveNxN), so the rounded
+            // coefficients times 255 must add up to less than 2^31; NaN fails the comparison as well
+            double magnitude = 0;
+            for (size_t index = 1; index < filter.params.size(); ++index) {
+                if (!IsFloat(filter.params[index])) {
+                    throw std::runtime_error("Convolution coefficients must be float numbers\n");
+                }
+                magnitude += (std::abs(std::strtod(filter.params[index].c_str(), nullptr)) * 4096 + 1) * 255;
+            }
+            if (!(magnitude < 2147483648.0)) {
+                throw std::runtime_error("Convolution coefficients are too large\n");
+            }
+        } else if (filter.name == "-contr") {
+            if (!filter.params.empty()) {
+                throw std::runtime_error("Auto Contrast filter doesn't have any parameters\n");
+            }
+        } else if (filter.name == "-gamma") {
+            if (filter.params.size() != 1) {
+                throw std::runtime_error("Gamma filter has only 1 parameter: sigma\n");
+            } else if (!IsFloat(filter.params[0])) {
+                throw std::runtime_error("Sigma parameter must be between 0.1 and 1.0\n");
+            } else if (std::stof(filter.params[0]) > 1 || std::stof(filter.params[0]) < 0.1) {
+                throw std::runtime_error("Sigma parameter must be between 0.1 and 1.0\n");
+            }
+        } else if (filter.name == "-pixel") {
+            if (filter.params.size() != 1) {
+                throw std::runtime_error("PixelImage filter has only 1 parameter: pixel size\n");
+            } else if (!IsAllDigits(filter.params[0])) {
+                throw std::runtime_error("Pixel size must be an integer, less then the size of the image\n");
+            }
+        } else if (filter.name == "-box") {
+            if (filter.params.size() != 1) {
+                throw std::runtime_error("Box filter has only 1 parameter: radius\n");
+            } else if (!IsAllDigits(filter.params[0])) {
+                throw std::runtime_error("Box radius must be a non-negative integer\n");
+            }
+        } else if (filter.name == "-bilateral") {
+            if (filter.params.size() != 2) {
+                throw std::runtime_error("Bilateral filter has 2 parameters: sigma_s and sigma_r\n");
+            } else if (!IsFloat(filter.params[0]) || !IsFloat(filter.params[1])) {
+                throw std::runtime_error("Bilateral filter parameters must be float numbers\n");
+            } else if (!(std::strtod(filter.params[0].c_str(), nullptr) >= 0.0) ||
+                       !(std::strtod(filter.params[1].c_str(), nullptr) > 0.0)) { // NaN fails both
+                throw std::runtime_error("Bilateral sigma_s must be non-negative and sigma_r positive\n");
+            } else if (std::strtod(filter.params[0].c_str(), nullptr) > 100) { // GuidedFilter::kMaxRadius
+                throw std::runtime_error("Bilateral sigma_s must be at most 100\n");
+            }
+        } else if (filter.name == "-flipv" || filter.name == "-fliph" || filter.name == "-rot90" ||
+                   filter.name == "-transpose") {
+            if (!filter.params.empty()) {
+                throw std::runtime_error("Flips, rotation and transpose don't have any parameters\n");
+            }
+        } else if (filter.name == "-resize") {
+            if (filter.params.size() < 2 || filter.params.size() > 3) {
+                throw std::runtime_error("Resize filter has width, height and an optional method\n");
+            } else if (!IsAllDigits(filter.params[0]) || !IsAllDigits(filter.params[1]) || filter.params[0].empty() ||
+                       filter.params[1].empty() || std::stoull(filter.params[0]) == 0 ||
+                       std::stoull(filter.params[1]) == 0) {
+                throw std::runtime_error("Resize width and height must be positive integers\n");
+            } else if (filter.params.size() == 3 && filter.params[2] != "lanczos" && filter.params[2] != "bicubic" &&
+                       filter.params[2] != "box") {
+                throw std::runtime_error("Resize method must be lanczos, bicubic or box\n");
+            }
+        } else if (filter.name == "-crystal") {
+            if (filter.params.empty() || filter.params.size() > 2) {
+                throw std::runtime_error("Crystallization filter has shard size and an optional seed\n");
+            } else if (!IsAllDigits(filter.params[0])) {
+                throw std::runtime_error("Shard size must be an integer, less then the size of the image\n");
+            } else if (filter.params.size() == 2 && !IsAllDigits(filter.params[1])) {
+                throw std::runtime_error("Crystallization seed must be a non-negative integer\n");
+            }
+        } else {
+            throw std::runtime_error(
+                    "The filter you have chosen is not supported by ImageProcessor.\n"
+                    "You can only choose filters from the following list:\n"
+                    "1.Crop (print -crop width height)\n"
+                    "2.Grayscale (print -gs)\n"
+                    "3.Negative (print -neg)\n"
+                    "4.Sharpening (print -sharp)\n"
+                    "5.Edge Detection (print -edge threshold)\n"
+                    "6.Gaussian Blur (print -blur sigma)\n"
+                    "7.Auto Contrast (print -contr)\n"
+                    "8.Gamma (print -gamma sigma)\n"
+                    "9.PixelImage (print -pixel pixel size)\n"
+                    "10.Crystallization (print -crystal shard size and an optional random seed)\n"
+                    "11.Convolution (print -conv size and size * size coefficients row by row)\n"
+                    "12.Box Blur (print -box radius)\n"
+                    "13.Bilateral (print -bilateral sigma_s sigma_r, edge-preserving smoothing)\n"
+                    "14.Vertical Flip (print -flipv)\n"
+                    "15.Horizontal Flip (print -fliph)\n"
+                    "16.Rotation (print -rot90, 90 degrees clockwise)\n"
+                    "17.Transpose (print -transpose, about the top-left to bottom-right diagonal)\n"
+                    "18.Resize (print -resize width height [lanczos|bicubic|box], lanczos by default)\n"
+                    "Remember that you can use multiple filters at once\n");
+        }
+    }
+    return results;
 }
 
 ParserResults ImageParser::Parse(int argc, const char *argv[]) {
-    if (argc == 1) {
+    ParserResults options;
+    std::vector<const char *> arguments; // everything except the options
+
+    for (int index = 0; index < argc; ++index) {
+        std::string argument = argv[index];
+        if (argument == "--threads") {
+            if (index + 1 == argc || argv[index + 1][0] == '\0' || !IsAllDigits(argv[index + 1])) {
+                throw std::runtime_error("--threads option needs the number of threads\n");
+            }
+            options.threads = std::stoull(argv[++index]);
+        } else if (argument == "--plan") {
+            options.print_plan = true;
+        } else if (argument == "--batch") {
+            options.batch_manifest = OptionValue(argc, argv, index++, "the manifest file");
+        } else if (argument == "--input-dir") {
+            options.input_dir = OptionValue(argc, argv, index++, "the input directory");
+        } else if (argument == "--output-dir") {
+            options.output_dir = OptionValue(argc, argv, index++, "the output directory");
+        } else if (argument == "--jobs") {
+            if (!IsAllDigits(OptionValue(argc, argv, index, "the number of images in flight"))) {
+                throw std::runtime_error("--jobs option needs the number of images in flight\n");
+            }
+            options.jobs = std::stoull(argv[++index]);
+        } else if (argument == "--profile") {
+            options.profile_file = OptionValue(argc, argv, index++, "the trace file");
+        } else if (argument == "--compress") {
+            options.compression = OptionValue(argc, argv, index++, "the compression method");
+            if (options.compression != "rle8") {
+                throw std::runtime_error("The only supported compression method is rle8\n");
+            }
+        } else if (argument.starts_with("--")) {
+            throw std::runtime_error("Unknown option " + argument + "\n");
+        } else {
+            arguments.push_back(argv[index]);
+        }
+    }
+    argc = static_cast<int>(arguments.size());
+    argv = arguments.data();
+
+    if (!options.batch_manifest.empty() && !options.input_dir.empty()) {
+        throw std::runtime_error("Choose either --batch or --input-dir\n");
+    } else if (!options.input_dir.empty() && options.output_dir.empty()) {
+        throw std::runtime_error("--input-dir needs --output-dir for the filtered images\n");
+    } else if (!options.output_dir.empty() && options.input_dir.empty()) {
+        throw std::runtime_error("--output-dir goes together with --input-dir\n");
+    }
+
+    if (argc == 1 && !options.IsBatch()) {
         throw std::runtime_error(
                 "You can choose filters from the following list:\n"
                 "1.Crop (print -crop width height)\n"
@@ -34,109 +262,39 @@ ParserResults ImageParser::Parse(int argc, const char *argv[]) {
                 "7.Auto Contrast (print -contr)\n"
                 "8.Gamma (print -gamma sigma)\n"
                 "9.PixelImage (print -pixel pixel size)\n"
-                "10.Crystallization (print -crystal shard size)\n"
-                "Remember that you can use multiple filters at once\n");
+                "10.Crystallization (print -crystal shard size and an optional random seed)\n"
+                "11.Convolution (print -conv size and size * size coefficients row by row)\n"
+                "12.Box Blur (print -box radius)\n"
+                "13.Bilateral (print -bilateral sigma_s sigma_r, edge-preserving smoothing)\n"
+                "14.Vertical Flip (print -flipv)\n"
+                "15.Horizontal Flip (print -fliph)\n"
+                "16.Rotation (print -rot90, 90 degrees clockwise)\n"
+                "17.Transpose (print -transpose, about the top-left to bottom-right diagonal)\n"
+                "18.Resize (print -resize width height [lanczos|bicubic|box], lanczos by default)\n"
+                "Remember that you can use multiple filters at once\n"
+                "Options:\n"
+                "--threads N (number of threads, 0 or no option means all hardware threads)\n"
+                "--plan (print how the filters are fused and reordered before applying them)\n"
+                "--batch manifest.txt (filter every \"input output\" pair of files listed in the manifest)\n"
+                "--input-dir DIR --output-dir DIR (filter every .bmp file of a directory)\n"
+                "--jobs N (number of images filtered at once in batch mode)\n"
+                "--profile trace.json (time every read, filter and write, print a summary and save a Chrome trace)\n"
+                "--compress rle8 (run-length encode the images that are written with 8 bits per pixel)\n");
+    } else if (options.IsBatch()) { // the filters go right after the program name
+        return ParseFilters(options, argc, argv, 1);
     } else if (argc < 3) {
         throw std::runtime_error("You need to write input and output files\n");
     } else if (argc == 3) {
         std::cout << "If you want to work with your BMP image, write down some filters\n";
-        return ParserResults{argv[1], argv[2], {}};
+        options.input_file_path = argv[1];
+        options.output_file_path = argv[2];
+        return options;
     } else {
-        ParserResults results;
-        results.input_file_path = argv[1];
-        results.output_file_path = argv[2];
-        if (argv[1] == argv[2]) {
+        if (std::string(argv[1]) == argv[2]) {
             throw std::runtime_error("input and output file should be different files, so that input is unchanged\n");
         }
-        int filter_index = -1;
-        FilterInfo empty_filter{"", {}};
-        for (size_t index = 3; index < argc; ++index) {
-            if (argv[index][0] == '-') {
-                ++filter_index;
-                results.filters.push_back(empty_filter);
-                results.filters[filter_index].name = argv[index];
-            } else {
-                if (filter_index == -1) {
-                    throw std::runtime_error("You haven't passed the name of the filter\n");
-                }
-                results.filters[filter_index].params.push_back(argv[index]);
-            }
-        }
-
-        for (const auto &filter : results.filters) {
-            if (filter.name == "-crop") {
-                if (filter.params.size() != 2) {
-                    throw std::runtime_error("Crop filter has 2 parameters: width and height\n");
-                } else if (!IsAllDigits(filter.params[0]) || !IsAllDigits(filter.params[1])) {
-                    throw std::runtime_error("Crop filter parameters (width and height) must be integers\n");
-                }
-            } else if (filter.name == "-gs") {
-                if (!filter.params.empty()) {
-                    throw std::runtime_error("Grayscale filter doesn't have any parameters\n");
-                }
-            } else if (filter.name == "-neg") {
-                if (!filter.params.empty()) {
-                    throw std::runtime_error("Negative filter doesn't have any parameters\n");
-                }
-            } else if (filter.name == "-sharp") {
-                if (!filter.params.empty()) {
-                    throw std::runtime_error("Sharpening filter doesn't have any parameters\n");
-                }
-            } else if (filter.name == "-edge") {
-                if (filter.params.size() != 1) {
-                    throw std::runtime_error("Edge Detection filter needs 1 parameter: threshold\n");
-                } else if (!IsFloat(filter.params[0])) {
-                    throw std::runtime_error("Edge Detection filter parameter (threshold) must be a float number\n");
-                } else if (std::stof(filter.params[0]) > 1 || std::stof(filter.params[0]) < 0.0) {
-                    throw std::runtime_error("Threshold must be between 0.0 and 1.0\n");
-                }
-            } else if (filter.name == "-blur") {
-                if (filter.params.size() != 1) {
-                    throw std::runtime_error("Gaussian Blur filter has only 1 parameter: sigma\n");
-                } else if (!IsFloat(filter.params[0])) {
-                    throw std::runtime_error("Sigma parameter must be a float number\n");
-                }
-            } else if (filter.name == "-contr") {
-                if (!filter.params.empty()) {
-                    throw std::runtime_error("Auto Contrast filter doesn't have any parameters\n");
-                }
-            } else if (filter.name == "-gamma") {
-                if (filter.params.size() != 1) {
-                    throw std::runtime_error("Gamma filter has only 1 parameter: sigma\n");
-                } else if (!IsFloat(filter.params[0])) {
-                    throw std::runtime_error("Sigma parameter must be between 0.1 and 1.0\n");
-                } else if (std::stof(filter.params[0]) > 1 || std::stof(filter.params[0]) < 0.1) {
-                    throw std::runtime_error("Sigma parameter must be between 0.1 and 1.0\n");
-                }
-            } else if (filter.name == "-pixel") {
-                if (filter.params.size() != 1) {
-                    throw std::runtime_error("PixelImage filter has only 1 parameter: pixel size\n");
-                } else if (!IsAllDigits(filter.params[0])) {
-                    throw std::runtime_error("Pixel size must be an integer, less then the size of the image\n");
-                }
-            } else if (filter.name == "-crystal") {
-                if (filter.params.size() != 1) {
-                    throw std::runtime_error("Crystallization filter has only 1 parameter: shard size\n");
-                } else if (!IsAllDigits(filter.params[0])) {
-                    throw std::runtime_error("Shard size must be an integer, less then the size of the image\n");
-                }
-            } else {
-                throw std::runtime_error(
-                        "The filter you have chosen is not supported by ImageProcessor.\n"
-                        "You can only choose filters from the following list:\n"
-                        "1.Crop (print -crop width height)\n"
-                        "2.Grayscale (print -gs)\n"
-                        "3.Negative (print -neg)\n"
-                        "4.Sharpening (print -sharp)\n"
-                        "5.Edge Detection (print -edge threshold)\n"
-                        "6.Gaussian Blur (print -blur sigma)\n"
-                        "7.Auto Contrast (print -contr)\n"
-                        "8.Gamma (print -gamma sigma)\n"
-                        "9.PixelImage (print -pixel pixel size)\n"
-                        "10.Crystallization (print -crystal shard size)\n"
-                        "Remember that you can use multiple filters at once\n");
-            }
-        }
-        return results;
+        options.input_file_path = argv[1];
+        options.output_file_path = argv[2];
+        return ParseFilters(options, argc, argv, 3);
     }
-}
\ No newline at end of file
+}
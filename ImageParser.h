@@ -13,6 +13,16 @@ struct ParserResults {
     std::string input_file_path;
     std::string output_file_path;
     std::vector<FilterInfo> filters;
+    size_t threads = 0; // 0 means one thread per hardware thread
+    bool print_plan = false; // print the optimized filter plan before running it
+    std::string batch_manifest; // batch mode: file with an "input output" pair of paths per line
+    std::string input_dir; // batch mode: every .bmp file of this directory goes to output_dir
+    std::string output_dir;
+    size_t jobs = 0; // batch mode: images in flight at once, 0 means the default
+    std::string profile_file; // if set, every read, filter and write is timed and the trace goes to this file
+    std::string compression; // "rle8" to run-length encode 8-bit outputs, empty means no compression
+
+    bool IsBatch() const;
 
     bool operator==(const ParserResults& other) const;
 };
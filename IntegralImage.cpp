@@ -0,0 +1,125 @@
+#include "IntegralImage.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+
+const size_t kColumnGrain = 256; // columns summed by one task in the second pass
+
+}
+
+IntegralImage::IntegralImage(const ImageBuffer &pixels) : height_(pixels.Height()), width_(pixels.Width()),
+                                                          sums_(ScratchArena::Instance().AcquireWords(
+                                                                  (height_ + 1) * (width_ + 1) * 3)) {
+    Build([&pixels](size_t i) { return reinterpret_cast<const uint8_t *>(pixels.Row(i)); });
+}
+
+IntegralImage::IntegralImage(const uint32_t *values, size_t height, size_t width)
+        : height_(height), width_(width),
+          sums_(ScratchArena::Instance().AcquireWords((height_ + 1) * (width_ + 1) * 3)) {
+    Build([values, width](size_t i) { return values + i * width * 3; });
+}
+
+template <typename Rows>
+void IntegralImage::Build(Rows rows) {
+    size_t stride = (width_ + 1) * 3;
+    std::fill(sums_.begin(), sums_.begin() + stride, 0); // the sums are reused, so the zero row and column are set
+
+    ParallelFor(0, height_, [this, &rows, stride](size_t begin, size_t end) { // prefix sums along every row
+        for (size_t i = begin; i < end; ++i) {
+            const auto *row = rows(i);
+            uint32_t *sums = sums_.data() + (i + 1) * stride;
+            sums[0] = sums[1] = sums[2] = 0;
+            for (size_t x = 0; x < width_ * 3; ++x) {
+                sums[x + 3] = sums[x] + row[x];
+            }
+        }
+    });
+    ParallelFor(0, stride, [this, stride](size_t begin, size_t end) { // then down the columns, row after row
+        for (size_t i = 1; i <= height_; ++i) {
+            const uint32_t *previous = sums_.data() + (i - 1) * stride;
+            uint32_t *current = sums_.data() + i * stride;
+            for (size_t x = begin; x < end; ++x) {
+                current[x] += previous[x];
+            }
+        }
+    }, kColumnGrain);
+}
+
+IntegralImage::~IntegralImage() {
+    ScratchArena::Instance().Release(std::move(sums_));
+}
+
+size_t IntegralImage::Height() const {
+    return height_;
+}
+
+size_t IntegralImage::Width() const {
+    return width_;
+}
+
+const uint32_t *IntegralImage::At(size_t row, size_t column) const {
+    return sums_.data() + (row * (width_ + 1) + column) * 3;
+}
+
+IntegralImage::Sums IntegralImage::Sum(size_t top, size_t left, size_t bottom, size_t right) const {
+    const uint32_t *top_left = At(top, left);
+    const uint32_t *top_right = At(top, right);
+    const uint32_t *bottom_left = At(bottom, left);
+    const uint32_t *bottom_right = At(bottom, right);
+    Sums sums;
+    for (size_t channel = 0; channel < 3; ++channel) { // wraps around in between, the result is still right
+        sums[channel] = bottom_right[channel] - bottom_left[channel] - top_right[channel] + top_left[channel];
+    }
+    return sums;
+}
+
+void IntegralImage::WindowSums(size_t top, size_t bottom, size_t left, size_t window, size_t count,
+                               uint32_t *out) const {
+    const uint32_t *upper = At(top, left);
+    const uint32_t *lower = At(bottom, left);
+    size_t shift = window * 3;
+    for (size_t x = 0; x < count * 3; ++x) { // plain array arithmetic, the compiler vectorizes it
+        out[x] = lower[x + shift] - lower[x] - upper[x + shift] + upper[x];
+    }
+}
+
+IntegralImage::Sums IntegralImage::ClampedSum(ptrdiff_t top, ptrdiff_t left, ptrdiff_t bottom,
+                                              ptrdiff_t right) const {
+    auto height = static_cast<ptrdiff_t>(height_);
+    auto width = static_cast<ptrdiff_t>(width_);
+    // the part inside the image plus how many times the first and the last row and column are repeated
+    size_t inner_top = std::clamp<ptrdiff_t>(top, 0, height - 1);
+    size_t inner_bottom = std::clamp<ptrdiff_t>(bottom, 1, height);
+    size_t inner_left = std::clamp<ptrdiff_t>(left, 0, width - 1);
+    size_t inner_right = std::clamp<ptrdiff_t>(right, 1, width);
+    auto extra_top = static_cast<uint32_t>(std::max<ptrdiff_t>(0, -top));
+    auto extra_bottom = static_cast<uint32_t>(std::max<ptrdiff_t>(0, bottom - height));
+    auto extra_left = static_cast<uint32_t>(std::max<ptrdiff_t>(0, -left));
+    auto extra_right = static_cast<uint32_t>(std::max<ptrdiff_t>(0, right - width));
+
+    Sums sums = Sum(inner_top, inner_left, inner_bottom, inner_right);
+    auto add = [&sums](uint32_t times, const Sums &part) {
+        for (size_t channel = 0; channel < 3; ++channel) {
+            sums[channel] += times * part[channel];
+        }
+    };
+    if (extra_top != 0) {
+        add(extra_top, Sum(0, inner_left, 1, inner_right));
+        add(extra_top * extra_left, Sum(0, 0, 1, 1));
+        add(extra_top * extra_right, Sum(0, width_ - 1, 1, width_));
+    }
+    if (extra_bottom != 0) {
+        add(extra_bottom, Sum(height_ - 1, inner_left, height_, inner_right));
+        add(extra_bottom * extra_left, Sum(height_ - 1, 0, height_, 1));
+        add(extra_bottom * extra_right, Sum(height_ - 1, width_ - 1, height_, width_));
+    }
+    if (extra_left != 0) {
+        add(extra_left, Sum(inner_top, 0, inner_bottom, 1));
+    }
+    if (extra_right != 0) {
+        add(extra_right, Sum(inner_top, width_ - 1, inner_bottom, width_));
+    }
+    return sums;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Summed-area table: the sums of every channel over any rectangle of pixels in O(1).
+// Sums are kept modulo 2^32, so a rectangle sum is exact as long as it fits into uint32, that is for rectangles
+// of up to kMaxArea pixels, no matter how large the image is.
+class IntegralImage {
+public:
+    using Sums = std::array<uint32_t, 3>; // red, green, blue
+
+    static constexpr size_t kMaxArea = UINT32_MAX / 255;
+
+    explicit IntegralImage(const ImageBuffer &pixels); // O(height * width), rows are summed in parallel
+
+    // the same for any values, 3 words per pixel row after row; a rectangle sum is exact as long as it fits into
+    // uint32
+    IntegralImage(const uint32_t *values, size_t height, size_t width);
+
+    IntegralImage(const IntegralImage &other) = default;
+
+    IntegralImage(IntegralImage &&other) noexcept = default;
+
+    ~IntegralImage(); // the sums go back to the scratch arena
+
+    size_t Height() const;
+
+    size_t Width() const;
+
+    // sums over rows [top, bottom) and columns [left, right) of the image
+    Sums Sum(size_t top, size_t left, size_t bottom, size_t right) const;
+
+    // sums over rows [top, bottom) of count neighbouring windows, window columns wide, the first one starting at
+    // column left; three sums per window are written to out
+    void WindowSums(size_t top, size_t bottom, size_t left, size_t window, size_t count, uint32_t *out) const;
+
+    // the same as Sum, but the rectangle may stick out of the image as long as it overlaps it,
+    // pixels outside repeat the nearest edge pixel
+    Sums ClampedSum(ptrdiff_t top, ptrdiff_t left, ptrdiff_t bottom, ptrdiff_t right) const;
+
+private:
+    template <typename Rows>
+    void Build(Rows rows); // rows(i) gives the width * 3 values of row i
+
+    const uint32_t *At(size_t row, size_t column) const; // sums over rows [0, row) and columns [0, column)
+
+    size_t height_;
+    size_t width_;
+    std::vector<uint32_t> sums_; // (height + 1) x (width + 1) x 3, the first row and column are zeros
+};
@@ -0,0 +1,45 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &file_name) : data_(nullptr), size_(0) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Cannot open input file\n");
+    }
+
+    struct stat file_info{};
+    if (fstat(fd, &file_info) == -1 || !S_ISREG(file_info.st_mode)) {
+        close(fd);
+        throw std::runtime_error("Input file must be a regular file\n");
+    }
+    size_ = file_info.st_size;
+
+    if (size_ != 0) {
+        void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map input file into memory\n");
+        }
+        madvise(mapping, size_, MADV_SEQUENTIAL); // filters mostly walk the rows in order
+        data_ = static_cast<const uint8_t *>(mapping);
+    }
+    close(fd); // the mapping stays valid without the descriptor
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+    }
+}
+
+const uint8_t *MappedFile::Data() const {
+    return data_;
+}
+
+size_t MappedFile::Size() const {
+    return size_;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile { // read-only memory mapping of a whole file
+public:
+    MappedFile(const std::string &file_name);
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    ~MappedFile();
+
+    const uint8_t *Data() const;
+
+    size_t Size() const;
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
@@ -0,0 +1,136 @@
+#include "Orientation.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+const size_t kTile = 32; // a tile reads kTile source rows at once, so their cache lines stay in L1
+
+size_t Flip(bool flipped, size_t index, size_t size) {
+    return flipped ? size - 1 - index : index;
+}
+
+// target(row, column) = source(column, row) with the flips of orientation, for a target of height x width;
+// every target row of a tile is written in one go from kTile source rows, instead of one source row per target pixel
+template <class T, class SourceRow, class TargetRow>
+void TransposeTiles(size_t height, size_t width, const Orientation &orientation, const SourceRow &source_row,
+                    const TargetRow &target_row) {
+    ParallelFor(0, (height + kTile - 1) / kTile, [&](size_t begin, size_t end) {
+        const T *sources[kTile];
+        for (size_t tile = begin; tile < end; ++tile) {
+            size_t first_row = tile * kTile;
+            size_t last_row = std::min(height, first_row + kTile);
+            for (size_t first_column = 0; first_column < width; first_column += kTile) {
+                size_t columns = std::min(kTile, width - first_column);
+                for (size_t k = 0; k < columns; ++k) {
+                    sources[k] = source_row(Flip(orientation.rows_flipped, first_column + k, width));
+                }
+                for (size_t row = first_row; row < last_row; ++row) {
+                    T *target = target_row(row) + first_column;
+                    size_t x = Flip(orientation.columns_flipped, row, height);
+                    for (size_t k = 0; k < columns; ++k) {
+                        target[k] = sources[k][x];
+                    }
+                }
+            }
+        }
+    });
+}
+
+}
+
+Orientation Orientation::FlipVertically() {
+    return {false, true, false};
+}
+
+Orientation Orientation::FlipHorizontally() {
+    return {false, false, true};
+}
+
+Orientation Orientation::Transpose() {
+    return {true, true, true}; // rows are counted bottom-up, so the top-left diagonal swaps them from the other ends
+}
+
+Orientation Orientation::Rotate90() {
+    return {true, false, true};
+}
+
+Orientation Orientation::Then(const Orientation &next) const {
+    // next flips the rows and columns it sees, those are columns and rows of the buffer if this one transposes
+    Orientation result{transposed != next.transposed, rows_flipped, columns_flipped};
+    result.rows_flipped ^= transposed ? next.columns_flipped : next.rows_flipped;
+    result.columns_flipped ^= transposed ? next.rows_flipped : next.columns_flipped;
+    return result;
+}
+
+bool Orientation::IsIdentity() const {
+    return !transposed && !rows_flipped && !columns_flipped;
+}
+
+Orientation::Region Orientation::Locate(const Region &region, size_t buffer_height, size_t buffer_width) const {
+    Region located = region;
+    if (transposed) {
+        located = {region.first_column, region.first_row, region.width, region.height};
+    }
+    if (rows_flipped) {
+        located.first_row = buffer_height - located.first_row - located.height;
+    }
+    if (columns_flipped) {
+        located.first_column = buffer_width - located.first_column - located.width;
+    }
+    return located;
+}
+
+ImageBuffer Orient(ImageBuffer pixels, const Orientation &orientation) {
+    if (orientation.transposed) {
+        ScratchArena &arena = ScratchArena::Instance();
+        ImageBuffer target = arena.Acquire(pixels.Width(), pixels.Height());
+        const ImageBuffer &source = pixels;
+        TransposeTiles<Pixel>(target.Height(), target.Width(), orientation,
+                              [&source](size_t index) { return source.Row(index); },
+                              [&target](size_t index) { return target.Row(index); });
+        arena.Release(std::move(pixels));
+        return target;
+    }
+    if (orientation.rows_flipped) {
+        pixels = std::move(pixels).Reversed();
+    }
+    if (orientation.columns_flipped) {
+        pixels.MakeWritable(); // rows are shared between threads
+        ParallelFor(0, pixels.Height(), [&pixels](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                std::reverse(pixels.Row(i), pixels.Row(i) + pixels.Width());
+            }
+        });
+    }
+    return pixels;
+}
+
+PlanarBuffer Orient(const PlanarBuffer &planes, const Orientation &orientation) {
+    size_t height = orientation.transposed ? planes.Width() : planes.Height();
+    size_t width = orientation.transposed ? planes.Height() : planes.Width();
+    PlanarBuffer target(height, width, planes.Channels());
+    for (size_t channel = 0; channel < planes.Channels(); ++channel) {
+        if (orientation.transposed) {
+            TransposeTiles<uint8_t>(height, width, orientation,
+                                    [&planes, channel](size_t index) { return planes.Row(channel, index); },
+                                    [&target, channel](size_t index) { return target.Row(channel, index); });
+            continue;
+        }
+        ParallelFor(0, height, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const uint8_t *source = planes.Row(channel, Flip(orientation.rows_flipped, i, height));
+                uint8_t *row = target.Row(channel, i);
+                if (orientation.columns_flipped) {
+                    std::reverse_copy(source, source + width, row);
+                } else {
+                    std::memcpy(row, source, width);
+                }
+            }
+        });
+    }
+    return target;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include "PlanarBuffer.h"
+
+// Flips and transposes still to be done to the pixels of an image. Pixel (row, column) of the image is found in its
+// buffer by swapping row and column if the image is transposed, then counting buffer rows and columns from the other
+// end if they are flipped. Rows are counted bottom-up, as everywhere else. Geometric filters only change this
+// mapping, the pixels are moved once, when something needs them in order (see Image::Materialize).
+struct Orientation {
+    struct Region { // a rectangle of rows and columns
+        size_t first_row;
+        size_t first_column;
+        size_t height;
+        size_t width;
+    };
+
+    bool transposed = false;
+    bool rows_flipped = false; // rows of the buffer, which are columns of the image if it is transposed
+    bool columns_flipped = false;
+
+    static Orientation FlipVertically(); // -flipv, the top row becomes the bottom one
+
+    static Orientation FlipHorizontally(); // -fliph
+
+    static Orientation Transpose(); // -transpose, about the diagonal that starts at the top-left corner
+
+    static Orientation Rotate90(); // -rot90, clockwise
+
+    Orientation Then(const Orientation &next) const; // this one, then next on its result
+
+    bool IsIdentity() const;
+
+    // where region of the image is in a buffer of buffer_height rows and buffer_width columns
+    Region Locate(const Region &region, size_t buffer_height, size_t buffer_width) const;
+};
+
+// the pixels moved to where the orientation says: row flips alone only reverse the order of rows (see
+// ImageBuffer::Reversed), column flips reverse rows in place, transposes go through a new buffer tile by tile
+ImageBuffer Orient(ImageBuffer pixels, const Orientation &orientation);
+
+PlanarBuffer Orient(const PlanarBuffer &planes, const Orientation &orientation); // every plane the same way
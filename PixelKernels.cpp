@@ -0,0 +1,805 @@
+#include "PixelKernels.h"
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMP_EDITOR_X86
+#endif
+
+namespace {
+
+// luma weights in 1/65536: 0.299, 0.587, 0.114 for grayscale and 0.299, 0.567, 0.114 for edge thresholding
+const uint16_t kGrayWeights[3] = {19595, 38470, 7471};
+const uint16_t kEdgeWeights[3] = {19595, 37159, 7471};
+
+// weighted sum in 1/256 units, the same rounding as _mm_mulhi_epu16(x << 8, weight) in the vector versions
+inline uint16_t Luma(const Pixel &pixel, const uint16_t *weights) {
+    return ((pixel.red << 8) * weights[0] >> 16) + ((pixel.green << 8) * weights[1] >> 16) +
+           ((pixel.blue << 8) * weights[2] >> 16);
+}
+
+// the gray level rounded to nearest from a 32-bit sum; the weights add up to 65536, so a gray (v, v, v) stays v
+inline uint8_t Gray(uint8_t red, uint8_t green, uint8_t blue) {
+    return (red * kGrayWeights[0] + green * kGrayWeights[1] + blue * kGrayWeights[2] + (1 << 15)) >> 16;
+}
+
+void GrayscaleScalar(Pixel *row, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t gray = Gray(row[i].red, row[i].green, row[i].blue);
+        row[i] = Pixel{gray, gray, gray};
+    }
+}
+
+void NegativeScalar(Pixel *row, size_t count) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    for (size_t i = 0; i < count * sizeof(Pixel); ++i) {
+        bytes[i] = 255 - bytes[i];
+    }
+}
+
+void ThresholdScalar(Pixel *row, size_t count, uint16_t threshold) {
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t color = Luma(row[i], kEdgeWeights) > threshold ? 255 : 0;
+        row[i] = Pixel{color, color, color};
+    }
+}
+
+void SplitScalar(const Pixel *row, size_t count, uint8_t *red, uint8_t *green, uint8_t *blue) {
+    for (size_t i = 0; i < count; ++i) {
+        red[i] = row[i].red;
+        green[i] = row[i].green;
+        blue[i] = row[i].blue;
+    }
+}
+
+void MergeScalar(const uint8_t *red, const uint8_t *green, const uint8_t *blue, size_t count, Pixel *row) {
+    for (size_t i = 0; i < count; ++i) {
+        row[i] = Pixel{red[i], green[i], blue[i]};
+    }
+}
+
+void GrayscalePlanesScalar(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t gray = Gray(red[i], green[i], blue[i]);
+        red[i] = gray;
+        green[i] = gray;
+        blue[i] = gray;
+    }
+}
+
+void UnpackBGRAScalar(const uint8_t *source, size_t count, Pixel *row, uint8_t *alpha) {
+    for (size_t i = 0; i < count; ++i, source += 4) {
+        row[i] = Pixel{source[0], source[1], source[2]};
+        if (alpha) {
+            alpha[i] = source[3];
+        }
+    }
+}
+
+void PackBGRAScalar(const Pixel *row, const uint8_t *alpha, size_t count, uint8_t *target) {
+    for (size_t i = 0; i < count; ++i, target += 4) {
+        target[0] = row[i].red;
+        target[1] = row[i].green;
+        target[2] = row[i].blue;
+        target[3] = alpha ? alpha[i] : 255;
+    }
+}
+
+const uint32_t kBoxShift = 24;
+
+void ScaleSumsScalar(const uint32_t *sums, size_t count, uint32_t reciprocal, uint8_t *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = (sums[i] * reciprocal + (1u << (kBoxShift - 1))) >> kBoxShift;
+    }
+}
+
+void SlideSumsScalar(uint32_t *sums, const uint8_t *entering, const uint8_t *leaving, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        sums[i] += entering[i] - leaving[i];
+    }
+}
+
+inline uint8_t Resampled(int32_t sum) { // the rounding and clamping of _mm_srai_epi32 and the saturating packs
+    sum = (sum + (1 << (kResampleShift - 1))) >> kResampleShift;
+    return sum < 0 ? 0 : (sum > 255 ? 255 : sum);
+}
+
+void ResampleColumnsScalar(const uint8_t *const *rows, const int16_t *weights, size_t taps, size_t length,
+                           uint8_t *out) {
+    for (size_t i = 0; i < length; ++i) {
+        int32_t sum = 0;
+        for (size_t k = 0; k < taps; ++k) {
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = Resampled(sum);
+    }
+}
+
+void ResampleRowScalar(const uint8_t *row, size_t channels, const uint32_t *first, const int16_t *weights,
+                       size_t taps, size_t count, uint8_t *out) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *source = row + first[i] * channels;
+        const int16_t *pixel_weights = weights + i * taps;
+        for (size_t channel = 0; channel < channels; ++channel) {
+            int32_t sum = 0;
+            for (size_t k = 0; k < taps; ++k) {
+                sum += pixel_weights[k] * source[k * channels + channel];
+            }
+            out[i * channels + channel] = Resampled(sum);
+        }
+    }
+}
+
+#ifdef BMP_EDITOR_X86
+
+// pshufb masks: split[channel][register] gathers one channel of 16 pixels stored in three registers,
+// merge[register] spreads 16 bytes back into three registers with every byte repeated for 3 channels,
+// interleave[register][channel] puts the bytes of one channel plane into their places in the three registers
+struct ShuffleMasks {
+    alignas(16) uint8_t split[3][3][16];
+    alignas(16) uint8_t merge[3][16];
+    alignas(16) uint8_t interleave[3][3][16];
+};
+
+constexpr ShuffleMasks MakeShuffleMasks() {
+    ShuffleMasks masks{};
+    for (size_t channel = 0; channel < 3; ++channel) {
+        for (size_t reg = 0; reg < 3; ++reg) {
+            for (size_t k = 0; k < 16; ++k) {
+                size_t position = 3 * k + channel;
+                masks.split[channel][reg][k] = position / 16 == reg ? position % 16 : 0x80;
+            }
+        }
+    }
+    for (size_t reg = 0; reg < 3; ++reg) {
+        for (size_t k = 0; k < 16; ++k) {
+            masks.merge[reg][k] = (16 * reg + k) / 3;
+            for (size_t channel = 0; channel < 3; ++channel) {
+                masks.interleave[reg][channel][k] = (16 * reg + k) % 3 == channel ? (16 * reg + k) / 3 : 0x80;
+            }
+        }
+    }
+    return masks;
+}
+
+constexpr ShuffleMasks kMasks = MakeShuffleMasks();
+
+template <typename Vector>
+struct Channels {
+    Vector first, second, third;
+};
+
+__attribute__((target("ssse3"))) inline __m128i Mask128(const uint8_t *mask) {
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+}
+
+// two weights side by side in every 32-bit lane, so _mm_madd_epi16 weighs a pair of interleaved bytes at once
+constexpr int32_t WeightPair(int16_t first, int16_t second) {
+    uint32_t high = static_cast<uint16_t>(second);
+    return static_cast<int32_t>(static_cast<uint16_t>(first) | high << 16);
+}
+
+// _mm_madd_epi16 multiplies signed words, so the green weight goes in as two halves below 2^15: one weighs green
+// together with red, the other together with blue
+constexpr int16_t kGreenHalf = 38470 / 2;
+constexpr int32_t kRedGreen = WeightPair(19595, kGreenHalf);
+constexpr int32_t kGreenBlue = WeightPair(kGreenHalf, 7471);
+
+// Gray of 16 pixels given as a vector of bytes per channel
+__attribute__((target("ssse3"))) inline __m128i Gray16(__m128i red, __m128i green, __m128i blue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(1 << 15);
+    __m128i words[2];
+    for (size_t part = 0; part < 2; ++part) {
+        __m128i r = part == 0 ? _mm_unpacklo_epi8(red, zero) : _mm_unpackhi_epi8(red, zero);
+        __m128i g = part == 0 ? _mm_unpacklo_epi8(green, zero) : _mm_unpackhi_epi8(green, zero);
+        __m128i b = part == 0 ? _mm_unpacklo_epi8(blue, zero) : _mm_unpackhi_epi8(blue, zero);
+        __m128i low = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), _mm_set1_epi32(kRedGreen)),
+                                    _mm_madd_epi16(_mm_unpacklo_epi16(g, b), _mm_set1_epi32(kGreenBlue)));
+        __m128i high = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), _mm_set1_epi32(kRedGreen)),
+                                     _mm_madd_epi16(_mm_unpackhi_epi16(g, b), _mm_set1_epi32(kGreenBlue)));
+        words[part] = _mm_packs_epi32(_mm_srli_epi32(_mm_add_epi32(low, half), 16),
+                                      _mm_srli_epi32(_mm_add_epi32(high, half), 16));
+    }
+    return _mm_packus_epi16(words[0], words[1]);
+}
+
+// one channel of the 16 pixels stored in a, b and c
+__attribute__((target("ssse3"))) inline __m128i Split16(__m128i a, __m128i b, __m128i c, size_t channel) {
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, Mask128(kMasks.split[channel][0])),
+                                     _mm_shuffle_epi8(b, Mask128(kMasks.split[channel][1]))),
+                        _mm_shuffle_epi8(c, Mask128(kMasks.split[channel][2])));
+}
+
+// weighted sum of 16 pixels in 1/256 units as two vectors of 8 uint16
+__attribute__((target("ssse3"))) inline void Luma16(__m128i a, __m128i b, __m128i c, const uint16_t *weights,
+                                                    __m128i &low, __m128i &high) {
+    __m128i zero = _mm_setzero_si128();
+    low = zero;
+    high = zero;
+    for (size_t channel = 0; channel < 3; ++channel) {
+        __m128i values = Split16(a, b, c, channel);
+        __m128i weight = _mm_set1_epi16(static_cast<short>(weights[channel]));
+        // unpacking with zero below the byte is the same as widening and shifting left by 8
+        low = _mm_add_epi16(low, _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, values), weight));
+        high = _mm_add_epi16(high, _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, values), weight));
+    }
+}
+
+__attribute__((target("ssse3"))) inline void Store16(uint8_t *bytes, __m128i values) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes), _mm_shuffle_epi8(values, Mask128(kMasks.merge[0])));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 16), _mm_shuffle_epi8(values, Mask128(kMasks.merge[1])));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 32), _mm_shuffle_epi8(values, Mask128(kMasks.merge[2])));
+}
+
+__attribute__((target("ssse3"))) void GrayscaleSSSE3(Pixel *row, size_t count) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, bytes += 48) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 32));
+        Store16(bytes, Gray16(Split16(a, b, c, 0), Split16(a, b, c, 1), Split16(a, b, c, 2)));
+    }
+    GrayscaleScalar(row + i, count - i);
+}
+
+__attribute__((target("ssse3"))) void NegativeSSSE3(Pixel *row, size_t count) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    size_t length = count * sizeof(Pixel);
+    __m128i ones = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i *address = reinterpret_cast<__m128i *>(bytes + i);
+        _mm_storeu_si128(address, _mm_xor_si128(_mm_loadu_si128(address), ones));
+    }
+    for (; i < length; ++i) {
+        bytes[i] = 255 - bytes[i];
+    }
+}
+
+__attribute__((target("ssse3"))) void ThresholdSSSE3(Pixel *row, size_t count, uint16_t threshold) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    __m128i limit = _mm_set1_epi16(static_cast<short>(threshold));
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, bytes += 48) {
+        __m128i low, high;
+        Luma16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes)),
+               _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 16)),
+               _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 32)), kEdgeWeights, low, high);
+        // luma > threshold exactly when the saturated difference is not zero
+        __m128i dark_low = _mm_cmpeq_epi16(_mm_subs_epu16(low, limit), zero);
+        __m128i dark_high = _mm_cmpeq_epi16(_mm_subs_epu16(high, limit), zero);
+        Store16(bytes, _mm_andnot_si128(_mm_packs_epi16(dark_low, dark_high), _mm_set1_epi8(-1)));
+    }
+    ThresholdScalar(row + i, count - i, threshold);
+}
+
+__attribute__((target("ssse3"))) void SplitSSSE3(const Pixel *row, size_t count, uint8_t *red, uint8_t *green,
+                                                  uint8_t *blue) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(row);
+    uint8_t *planes[3] = {red, green, blue};
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, bytes += 48) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 32));
+        for (size_t channel = 0; channel < 3; ++channel) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(planes[channel] + i), Split16(a, b, c, channel));
+        }
+    }
+    SplitScalar(row + i, count - i, red + i, green + i, blue + i);
+}
+
+__attribute__((target("ssse3"))) void MergeSSSE3(const uint8_t *red, const uint8_t *green, const uint8_t *blue,
+                                                  size_t count, Pixel *row) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, bytes += 48) {
+        __m128i channels[3] = {_mm_loadu_si128(reinterpret_cast<const __m128i *>(red + i)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i *>(green + i)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i *>(blue + i))};
+        for (size_t reg = 0; reg < 3; ++reg) {
+            __m128i merged = _mm_setzero_si128();
+            for (size_t channel = 0; channel < 3; ++channel) {
+                merged = _mm_or_si128(merged, _mm_shuffle_epi8(channels[channel],
+                                                               Mask128(kMasks.interleave[reg][channel])));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 16 * reg), merged);
+        }
+    }
+    MergeScalar(red + i, green + i, blue + i, count - i, row + i);
+}
+
+// 4 BGRA pixels become 12 bytes of BGR followed by their 4 alpha bytes, and the other way round
+constexpr uint8_t kUnpackBGRA[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 3, 7, 11, 15};
+constexpr uint8_t kPackBGR[16] = {0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11, 0x80};
+constexpr uint8_t kPackAlpha[16] = {0x80, 0x80, 0x80, 0, 0x80, 0x80, 0x80, 1, 0x80, 0x80, 0x80, 2, 0x80, 0x80, 0x80, 3};
+
+// 16 byte stores and loads of 24-bit pixels reach 4 bytes past the 4 pixels, the loops stop 2 pixels earlier
+__attribute__((target("ssse3"))) void UnpackBGRASSSE3(const uint8_t *source, size_t count, Pixel *row,
+                                                       uint8_t *alpha) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kUnpackBGRA));
+    size_t i = 0;
+    for (; i + 6 <= count; i += 4) {
+        __m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 4 * i)), mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 3 * i), pixels);
+        if (alpha) {
+            int32_t four = _mm_cvtsi128_si32(_mm_srli_si128(pixels, 12));
+            std::memcpy(alpha + i, &four, sizeof(four));
+        }
+    }
+    UnpackBGRAScalar(source + 4 * i, count - i, row + i, alpha ? alpha + i : nullptr);
+}
+
+__attribute__((target("ssse3"))) void PackBGRASSSE3(const Pixel *row, const uint8_t *alpha, size_t count,
+                                                     uint8_t *target) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(row);
+    __m128i bgr_mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kPackBGR));
+    __m128i alpha_mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kPackAlpha));
+    __m128i opaque = _mm_set1_epi32(static_cast<int32_t>(0xFF000000u));
+    size_t i = 0;
+    for (; i + 6 <= count; i += 4) {
+        __m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 3 * i)),
+                                          bgr_mask);
+        if (alpha) {
+            int32_t four;
+            std::memcpy(&four, alpha + i, sizeof(four));
+            pixels = _mm_or_si128(pixels, _mm_shuffle_epi8(_mm_cvtsi32_si128(four), alpha_mask));
+        } else {
+            pixels = _mm_or_si128(pixels, opaque);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target + 4 * i), pixels);
+    }
+    PackBGRAScalar(row + i, alpha ? alpha + i : nullptr, count - i, target + 4 * i);
+}
+
+// planes need no shuffles: bytes of one channel are already side by side
+__attribute__((target("ssse3"))) void GrayscalePlanesSSSE3(uint8_t *red, uint8_t *green, uint8_t *blue,
+                                                            size_t count) {
+    uint8_t *planes[3] = {red, green, blue};
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i gray = Gray16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(red + i)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(green + i)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(blue + i)));
+        for (auto *plane: planes) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(plane + i), gray);
+        }
+    }
+    GrayscalePlanesScalar(red + i, green + i, blue + i, count - i);
+}
+
+__attribute__((target("ssse3"))) void ResampleColumnsSSSE3(const uint8_t *const *rows, const int16_t *weights,
+                                                           size_t taps, size_t length, uint8_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(1 << (kResampleShift - 1));
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i sums[4] = {half, half, half, half};
+        for (size_t k = 0; k < taps; k += 2) { // rows k and k + 1 interleaved, an odd last one gets a zero partner
+            bool pair = k + 1 < taps;
+            __m128i weight = _mm_set1_epi32(WeightPair(weights[k], pair ? weights[k + 1] : 0));
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[pair ? k + 1 : k] + i));
+            __m128i low = _mm_unpacklo_epi8(a, b);
+            __m128i high = _mm_unpackhi_epi8(a, b);
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), weight));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), weight));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), weight));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), weight));
+        }
+        for (auto &sum: sums) {
+            sum = _mm_srai_epi32(sum, kResampleShift);
+        }
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bytes);
+    }
+    for (; i < length; ++i) {
+        int32_t sum = 0;
+        for (size_t k = 0; k < taps; ++k) {
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = Resampled(sum);
+    }
+}
+
+// B, G, R of two neighbouring pixels spread to 16-bit lanes as b0 b1 g0 g1 r0 r1, a lone pixel as b0 0 g0 0 r0 0
+constexpr uint8_t kPixelPair[16] = {0, 0x80, 3, 0x80, 1, 0x80, 4, 0x80, 2, 0x80, 5, 0x80, 0x80, 0x80, 0x80, 0x80};
+constexpr uint8_t kLonePixel[16] = {0, 0x80, 0x80, 0x80, 1, 0x80, 0x80, 0x80, 2, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+                                    0x80};
+
+// one output pixel at a time, two taps per _mm_madd_epi16; pixels are copied in whole, so no load goes past the
+// last tap of a row
+__attribute__((target("ssse3"))) void ResampleRowSSSE3(const uint8_t *row, size_t channels, const uint32_t *first,
+                                                       const int16_t *weights, size_t taps, size_t count,
+                                                       uint8_t *out) {
+    if (channels != 3) {
+        ResampleRowScalar(row, channels, first, weights, taps, count, out);
+        return;
+    }
+    const __m128i pair_mask = Mask128(kPixelPair);
+    const __m128i lone_mask = Mask128(kLonePixel);
+    const __m128i half = _mm_set1_epi32(1 << (kResampleShift - 1));
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *source = row + 3 * first[i];
+        const int16_t *pixel_weights = weights + i * taps;
+        __m128i sum = half;
+        size_t k = 0;
+        for (; k + 2 <= taps; k += 2) {
+            uint64_t bytes = 0;
+            std::memcpy(&bytes, source + 3 * k, 6);
+            __m128i pixels = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&bytes)), pair_mask);
+            __m128i weight = _mm_set1_epi32(WeightPair(pixel_weights[k], pixel_weights[k + 1]));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels, weight));
+        }
+        if (k < taps) {
+            uint64_t bytes = 0;
+            std::memcpy(&bytes, source + 3 * k, 3);
+            __m128i pixels = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&bytes)), lone_mask);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels, _mm_set1_epi32(WeightPair(pixel_weights[k], 0))));
+        }
+        sum = _mm_srai_epi32(sum, kResampleShift);
+        uint32_t pixel = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(sum, sum), sum)));
+        std::memcpy(out + 3 * i, &pixel, 3);
+    }
+}
+
+__attribute__((target("avx2"))) inline __m256i Mask256(const uint8_t *mask) {
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(mask)));
+}
+
+// two groups of 16 pixels, one per 128-bit lane, because pshufb never crosses lanes
+__attribute__((target("avx2"))) inline __m256i Load2x16(const uint8_t *bytes) {
+    return _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 48)), 1);
+}
+
+// one channel of the two groups of 16 pixels loaded by Load2x16 into a, b and c
+__attribute__((target("avx2"))) inline __m256i Split2x16(__m256i a, __m256i b, __m256i c, size_t channel) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, Mask256(kMasks.split[channel][0])),
+                                           _mm256_shuffle_epi8(b, Mask256(kMasks.split[channel][1]))),
+                           _mm256_shuffle_epi8(c, Mask256(kMasks.split[channel][2])));
+}
+
+// Gray16 on both 128-bit lanes; unpacks and packs work per lane, so the bytes keep their order
+__attribute__((target("avx2"))) inline __m256i Gray32(__m256i red, __m256i green, __m256i blue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi32(1 << 15);
+    __m256i words[2];
+    for (size_t part = 0; part < 2; ++part) {
+        __m256i r = part == 0 ? _mm256_unpacklo_epi8(red, zero) : _mm256_unpackhi_epi8(red, zero);
+        __m256i g = part == 0 ? _mm256_unpacklo_epi8(green, zero) : _mm256_unpackhi_epi8(green, zero);
+        __m256i b = part == 0 ? _mm256_unpacklo_epi8(blue, zero) : _mm256_unpackhi_epi8(blue, zero);
+        __m256i low = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), _mm256_set1_epi32(kRedGreen)),
+                                       _mm256_madd_epi16(_mm256_unpacklo_epi16(g, b), _mm256_set1_epi32(kGreenBlue)));
+        __m256i high = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), _mm256_set1_epi32(kRedGreen)),
+                                        _mm256_madd_epi16(_mm256_unpackhi_epi16(g, b), _mm256_set1_epi32(kGreenBlue)));
+        words[part] = _mm256_packs_epi32(_mm256_srli_epi32(_mm256_add_epi32(low, half), 16),
+                                         _mm256_srli_epi32(_mm256_add_epi32(high, half), 16));
+    }
+    return _mm256_packus_epi16(words[0], words[1]);
+}
+
+__attribute__((target("avx2"))) inline void Luma32(const uint8_t *bytes, const uint16_t *weights, __m256i &low,
+                                                   __m256i &high) {
+    __m256i a = Load2x16(bytes);
+    __m256i b = Load2x16(bytes + 16);
+    __m256i c = Load2x16(bytes + 32);
+    __m256i zero = _mm256_setzero_si256();
+    low = zero;
+    high = zero;
+    for (size_t channel = 0; channel < 3; ++channel) {
+        __m256i values = Split2x16(a, b, c, channel);
+        __m256i weight = _mm256_set1_epi16(static_cast<short>(weights[channel]));
+        low = _mm256_add_epi16(low, _mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, values), weight));
+        high = _mm256_add_epi16(high, _mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, values), weight));
+    }
+}
+
+__attribute__((target("avx2"))) inline void Store2x16(uint8_t *bytes, __m256i values) {
+    for (size_t reg = 0; reg < 3; ++reg) {
+        __m256i merged = _mm256_shuffle_epi8(values, Mask256(kMasks.merge[reg]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 16 * reg), _mm256_castsi256_si128(merged));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 48 + 16 * reg), _mm256_extracti128_si256(merged, 1));
+    }
+}
+
+__attribute__((target("avx2"))) void GrayscaleAVX2(Pixel *row, size_t count) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, bytes += 96) {
+        __m256i a = Load2x16(bytes);
+        __m256i b = Load2x16(bytes + 16);
+        __m256i c = Load2x16(bytes + 32);
+        Store2x16(bytes, Gray32(Split2x16(a, b, c, 0), Split2x16(a, b, c, 1), Split2x16(a, b, c, 2)));
+    }
+    GrayscaleSSSE3(row + i, count - i);
+}
+
+__attribute__((target("avx2"))) void NegativeAVX2(Pixel *row, size_t count) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    size_t length = count * sizeof(Pixel);
+    __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i *address = reinterpret_cast<__m256i *>(bytes + i);
+        _mm256_storeu_si256(address, _mm256_xor_si256(_mm256_loadu_si256(address), ones));
+    }
+    for (; i < length; ++i) {
+        bytes[i] = 255 - bytes[i];
+    }
+}
+
+__attribute__((target("avx2"))) void ThresholdAVX2(Pixel *row, size_t count, uint16_t threshold) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    __m256i limit = _mm256_set1_epi16(static_cast<short>(threshold));
+    __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, bytes += 96) {
+        __m256i low, high;
+        Luma32(bytes, kEdgeWeights, low, high);
+        __m256i dark_low = _mm256_cmpeq_epi16(_mm256_subs_epu16(low, limit), zero);
+        __m256i dark_high = _mm256_cmpeq_epi16(_mm256_subs_epu16(high, limit), zero);
+        Store2x16(bytes, _mm256_andnot_si256(_mm256_packs_epi16(dark_low, dark_high), _mm256_set1_epi8(-1)));
+    }
+    ThresholdSSSE3(row + i, count - i, threshold);
+}
+
+__attribute__((target("avx2"))) void SplitAVX2(const Pixel *row, size_t count, uint8_t *red, uint8_t *green,
+                                                uint8_t *blue) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(row);
+    uint8_t *planes[3] = {red, green, blue};
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, bytes += 96) { // pixels 0-15 in the low lane, 16-31 in the high one
+        __m256i a = Load2x16(bytes);
+        __m256i b = Load2x16(bytes + 16);
+        __m256i c = Load2x16(bytes + 32);
+        for (size_t channel = 0; channel < 3; ++channel) {
+            __m256i values = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_shuffle_epi8(a, Mask256(kMasks.split[channel][0])),
+                                    _mm256_shuffle_epi8(b, Mask256(kMasks.split[channel][1]))),
+                    _mm256_shuffle_epi8(c, Mask256(kMasks.split[channel][2])));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(planes[channel] + i), values);
+        }
+    }
+    SplitSSSE3(row + i, count - i, red + i, green + i, blue + i);
+}
+
+__attribute__((target("avx2"))) void MergeAVX2(const uint8_t *red, const uint8_t *green, const uint8_t *blue,
+                                                size_t count, Pixel *row) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(row);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, bytes += 96) {
+        __m256i channels[3] = {_mm256_loadu_si256(reinterpret_cast<const __m256i *>(red + i)),
+                               _mm256_loadu_si256(reinterpret_cast<const __m256i *>(green + i)),
+                               _mm256_loadu_si256(reinterpret_cast<const __m256i *>(blue + i))};
+        for (size_t reg = 0; reg < 3; ++reg) {
+            __m256i merged = _mm256_setzero_si256();
+            for (size_t channel = 0; channel < 3; ++channel) {
+                merged = _mm256_or_si256(merged, _mm256_shuffle_epi8(channels[channel],
+                                                                     Mask256(kMasks.interleave[reg][channel])));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 16 * reg), _mm256_castsi256_si128(merged));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + 48 + 16 * reg), _mm256_extracti128_si256(merged, 1));
+        }
+    }
+    MergeSSSE3(red + i, green + i, blue + i, count - i, row + i);
+}
+
+__attribute__((target("avx2"))) void GrayscalePlanesAVX2(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) {
+    uint8_t *planes[3] = {red, green, blue};
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i gray = Gray32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(red + i)),
+                              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(green + i)),
+                              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(blue + i)));
+        for (auto *plane: planes) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(plane + i), gray);
+        }
+    }
+    GrayscalePlanesSSSE3(red + i, green + i, blue + i, count - i);
+}
+
+__attribute__((target("avx2"))) inline __m256i Scale8(const uint32_t *sums, __m256i reciprocal, __m256i half) {
+    __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sums));
+    return _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(values, reciprocal), half), kBoxShift);
+}
+
+__attribute__((target("avx2"))) void ScaleSumsAVX2(const uint32_t *sums, size_t count, uint32_t reciprocal,
+                                                   uint8_t *out) {
+    __m256i factor = _mm256_set1_epi32(static_cast<int>(reciprocal));
+    __m256i half = _mm256_set1_epi32(1 << (kBoxShift - 1));
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7); // packs work per 128-bit lane
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i first = _mm256_packus_epi32(Scale8(sums + i, factor, half), Scale8(sums + i + 8, factor, half));
+        __m256i second = _mm256_packus_epi32(Scale8(sums + i + 16, factor, half), Scale8(sums + i + 24, factor, half));
+        __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(first, second), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bytes);
+    }
+    ScaleSumsScalar(sums + i, count - i, reciprocal, out + i);
+}
+
+__attribute__((target("avx2"))) void SlideSumsAVX2(uint32_t *sums, const uint8_t *entering, const uint8_t *leaving,
+                                                   size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i in = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(entering + i)));
+        __m256i out = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(leaving + i)));
+        __m256i *address = reinterpret_cast<__m256i *>(sums + i);
+        _mm256_storeu_si256(address, _mm256_add_epi32(_mm256_loadu_si256(address), _mm256_sub_epi32(in, out)));
+    }
+    SlideSumsScalar(sums + i, entering + i, leaving + i, count - i);
+}
+
+// ResampleColumnsSSSE3 on 32 bytes; unpacks and packs both work per 128-bit lane, so the bytes come out in order
+__attribute__((target("avx2"))) void ResampleColumnsAVX2(const uint8_t *const *rows, const int16_t *weights,
+                                                         size_t taps, size_t length, uint8_t *out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi32(1 << (kResampleShift - 1));
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i sums[4] = {half, half, half, half};
+        for (size_t k = 0; k < taps; k += 2) {
+            bool pair = k + 1 < taps;
+            __m256i weight = _mm256_set1_epi32(WeightPair(weights[k], pair ? weights[k + 1] : 0));
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k] + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[pair ? k + 1 : k] + i));
+            __m256i low = _mm256_unpacklo_epi8(a, b);
+            __m256i high = _mm256_unpackhi_epi8(a, b);
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), weight));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), weight));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), weight));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), weight));
+        }
+        for (auto &sum: sums) {
+            sum = _mm256_srai_epi32(sum, kResampleShift);
+        }
+        __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(sums[0], sums[1]),
+                                            _mm256_packs_epi32(sums[2], sums[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bytes);
+    }
+    for (; i < length; ++i) {
+        int32_t sum = 0;
+        for (size_t k = 0; k < taps; ++k) {
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = Resampled(sum);
+    }
+}
+
+#endif
+
+struct Kernels {
+    const char *name;
+    void (*grayscale)(Pixel *, size_t);
+    void (*negative)(Pixel *, size_t);
+    void (*threshold)(Pixel *, size_t, uint16_t);
+    void (*scale_sums)(const uint32_t *, size_t, uint32_t, uint8_t *);
+    void (*slide_sums)(uint32_t *, const uint8_t *, const uint8_t *, size_t);
+    void (*split)(const Pixel *, size_t, uint8_t *, uint8_t *, uint8_t *);
+    void (*merge)(const uint8_t *, const uint8_t *, const uint8_t *, size_t, Pixel *);
+    void (*grayscale_planes)(uint8_t *, uint8_t *, uint8_t *, size_t);
+    void (*unpack_bgra)(const uint8_t *, size_t, Pixel *, uint8_t *);
+    void (*pack_bgra)(const Pixel *, const uint8_t *, size_t, uint8_t *);
+    void (*resample_columns)(const uint8_t *const *, const int16_t *, size_t, size_t, uint8_t *);
+    void (*resample_row)(const uint8_t *, size_t, const uint32_t *, const int16_t *, size_t, size_t, uint8_t *);
+};
+
+Kernels DetectKernels() {
+#ifdef BMP_EDITOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {"avx2", GrayscaleAVX2, NegativeAVX2, ThresholdAVX2, ScaleSumsAVX2, SlideSumsAVX2, SplitAVX2, MergeAVX2,
+                GrayscalePlanesAVX2, UnpackBGRASSSE3, PackBGRASSSE3, ResampleColumnsAVX2, ResampleRowSSSE3};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {"ssse3", GrayscaleSSSE3, NegativeSSSE3, ThresholdSSSE3, ScaleSumsScalar, SlideSumsScalar, SplitSSSE3,
+                MergeSSSE3, GrayscalePlanesSSSE3, UnpackBGRASSSE3, PackBGRASSSE3, ResampleColumnsSSSE3,
+                ResampleRowSSSE3};
+    }
+#endif
+    return {"scalar", GrayscaleScalar, NegativeScalar, ThresholdScalar, ScaleSumsScalar, SlideSumsScalar, SplitScalar,
+            MergeScalar, GrayscalePlanesScalar, UnpackBGRAScalar, PackBGRAScalar, ResampleColumnsScalar,
+            ResampleRowScalar};
+}
+
+const Kernels &ActiveKernels() {
+    static const Kernels kernels = DetectKernels();
+    return kernels;
+}
+
+}
+
+void GrayscaleRow(Pixel *row, size_t count) {
+    ActiveKernels().grayscale(row, count);
+}
+
+void NegativeRow(Pixel *row, size_t count) {
+    ActiveKernels().negative(row, count);
+}
+
+void ThresholdRow(Pixel *row, size_t count, uint16_t threshold) {
+    ActiveKernels().threshold(row, count, threshold);
+}
+
+uint32_t BoxReciprocal(size_t window) {
+    return static_cast<uint32_t>(((uint64_t{1} << kBoxShift) + window / 2) / window);
+}
+
+void ScaleSums(const uint32_t *sums, size_t count, uint32_t reciprocal, uint8_t *out) {
+    ActiveKernels().scale_sums(sums, count, reciprocal, out);
+}
+
+void SlideSums(uint32_t *sums, const uint8_t *entering, const uint8_t *leaving, size_t count) {
+    ActiveKernels().slide_sums(sums, entering, leaving, count);
+}
+
+void SplitRow(const Pixel *row, size_t count, uint8_t *red, uint8_t *green, uint8_t *blue) {
+    ActiveKernels().split(row, count, red, green, blue);
+}
+
+void MergeRow(const uint8_t *red, const uint8_t *green, const uint8_t *blue, size_t count, Pixel *row) {
+    ActiveKernels().merge(red, green, blue, count, row);
+}
+
+void GrayscalePlanes(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count) {
+    ActiveKernels().grayscale_planes(red, green, blue, count);
+}
+
+void UnpackBGRA(const uint8_t *source, size_t count, Pixel *row, uint8_t *alpha) {
+    ActiveKernels().unpack_bgra(source, count, row, alpha);
+}
+
+void PackBGRA(const Pixel *row, const uint8_t *alpha, size_t count, uint8_t *target) {
+    ActiveKernels().pack_bgra(row, alpha, count, target);
+}
+
+void ResampleColumns(const uint8_t *const *rows, const int16_t *weights, size_t taps, size_t length, uint8_t *out) {
+    ActiveKernels().resample_columns(rows, weights, taps, length, out);
+}
+
+void ResampleRow(const uint8_t *row, size_t channels, const uint32_t *first, const int16_t *weights, size_t taps,
+                 size_t count, uint8_t *out) {
+    ActiveKernels().resample_row(row, channels, first, weights, taps, count, out);
+}
+
+void ExpandIndices(const uint8_t *indices, size_t count, const Pixel *palette, Pixel *row) {
+    for (size_t i = 0; i < count; ++i) {
+        row[i] = palette[indices[i]];
+    }
+}
+
+void LookupRow(Pixel *row, size_t count, const uint8_t *table) {
+    LookupBytes(reinterpret_cast<uint8_t *>(row), count * sizeof(Pixel), table);
+}
+
+void LookupBytes(uint8_t *bytes, size_t length, const uint8_t *table) {
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) { // independent loads, so several lookups are in flight at once
+        uint8_t first = table[bytes[i]];
+        uint8_t second = table[bytes[i + 1]];
+        uint8_t third = table[bytes[i + 2]];
+        uint8_t fourth = table[bytes[i + 3]];
+        bytes[i] = first;
+        bytes[i + 1] = second;
+        bytes[i + 2] = third;
+        bytes[i + 3] = fourth;
+    }
+    for (; i < length; ++i) {
+        bytes[i] = table[bytes[i]];
+    }
+}
+
+const char *PixelKernelsName() {
+    return ActiveKernels().name;
+}
+
+bool CpuSupportsAVX2() {
+    return std::string_view(ActiveKernels().name) == "avx2";
+}
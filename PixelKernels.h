@@ -0,0 +1,70 @@
+#pragma once
+
+#include "BMPstruct.h"
+#include <cstddef>
+#include <cstdint>
+
+// Point kernels over a run of interleaved 24-bit pixels. Every kernel has a scalar, an SSSE3 and an AVX2 version
+// with exactly the same fixed-point arithmetic, the fastest one the CPU supports is chosen on the first call.
+// The box blur kernels need 32-bit multiplies that SSSE3 lacks, so they only come in scalar and AVX2 versions.
+
+void GrayscaleRow(Pixel *row, size_t count);
+
+void NegativeRow(Pixel *row, size_t count);
+
+// pixels brighter than threshold become white, the others black; threshold is in 1/256 of a brightness unit
+void ThresholdRow(Pixel *row, size_t count, uint16_t threshold);
+
+// Box blur arithmetic. A window sum s of an odd window of d pixels is divided by multiplying with the reciprocal
+// m = round(2^24 / d) and shifting: (s * m + 2^23) >> 24. The product is s / d + e with |e| <= 255 * d / 2^25,
+// while s / d is never closer than 1 / (2 * d) to a half, so the result equals round(s / d) exactly for windows
+// of up to kExactBoxWindow pixels and is off by at most 1 for larger ones. Everything fits into uint32 for windows
+// of less than kMaxBoxWindow pixels.
+inline constexpr size_t kExactBoxWindow = 255;
+inline constexpr size_t kMaxBoxWindow = 65793;
+
+uint32_t BoxReciprocal(size_t window);
+
+// out[i] = (sums[i] * reciprocal + 2^23) >> 24
+void ScaleSums(const uint32_t *sums, size_t count, uint32_t reciprocal, uint8_t *out);
+
+// sums[i] += entering[i] - leaving[i], sums of a window sliding by one row
+void SlideSums(uint32_t *sums, const uint8_t *entering, const uint8_t *leaving, size_t count);
+
+// Resampling arithmetic (see Resample.h): weights are in 1/2^kResampleShift, a sum of weighted bytes is rounded,
+// shifted and clamped to 0..255. The vertical kernel works on any run of bytes and comes in all three versions; the
+// horizontal one gathers pixels, it has a scalar version and an SSSE3 one for 3 bytes per pixel.
+inline constexpr int kResampleShift = 14;
+
+// out[i] = sum of weights[k] * rows[k][i] over k < taps, for i < length
+void ResampleColumns(const uint8_t *const *rows, const int16_t *weights, size_t taps, size_t length, uint8_t *out);
+
+// pixel i of out (channels bytes each) = sum of weights[i * taps + k] * pixel first[i] + k of row over k < taps
+void ResampleRow(const uint8_t *row, size_t channels, const uint32_t *first, const int16_t *weights, size_t taps,
+                 size_t count, uint8_t *out);
+
+// replaces every channel byte v with table[v]; byte lookups beat gathers, so this one has a single scalar version
+void LookupRow(Pixel *row, size_t count, const uint8_t *table);
+
+void LookupBytes(uint8_t *bytes, size_t length, const uint8_t *table); // the same for a plane or any run of bytes
+
+// Planar kernels: the channels of a run of pixels in three separate byte arrays (see PlanarBuffer)
+
+void SplitRow(const Pixel *row, size_t count, uint8_t *red, uint8_t *green, uint8_t *blue);
+
+void MergeRow(const uint8_t *red, const uint8_t *green, const uint8_t *blue, size_t count, Pixel *row);
+
+void GrayscalePlanes(uint8_t *red, uint8_t *green, uint8_t *blue, size_t count); // the same result as GrayscaleRow
+
+// Format kernels: rows of 32-bit and 8-bit BMP files. 32-bit pixels are B, G, R and a fourth byte (alpha or
+// reserved) that goes to a separate plane; they only move bytes, so there are scalar and SSSE3 versions only.
+
+void UnpackBGRA(const uint8_t *source, size_t count, Pixel *row, uint8_t *alpha); // alpha may be null
+
+void PackBGRA(const Pixel *row, const uint8_t *alpha, size_t count, uint8_t *target); // no alpha means 255
+
+void ExpandIndices(const uint8_t *indices, size_t count, const Pixel *palette, Pixel *row); // palette lookups
+
+const char *PixelKernelsName(); // "avx2", "ssse3" or "scalar"
+
+bool CpuSupportsAVX2();
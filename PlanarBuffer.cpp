@@ -0,0 +1,99 @@
+#include "PlanarBuffer.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include <utility>
+
+PlanarBuffer::PlanarBuffer() : height_(0), width_(0), first_row_(0), first_column_(0), plane_rows_(0) {}
+
+PlanarBuffer::PlanarBuffer(size_t height, size_t width, size_t channels)
+        : height_(height), width_(width), first_row_(0), first_column_(0), plane_rows_(height),
+          storage_(ScratchArena::Instance().Acquire(channels * height, (width + sizeof(Pixel) - 1) / sizeof(Pixel))) {}
+
+PlanarBuffer::PlanarBuffer(PlanarBuffer &&other) noexcept: height_(std::exchange(other.height_, 0)),
+                                                            width_(std::exchange(other.width_, 0)),
+                                                            first_row_(std::exchange(other.first_row_, 0)),
+                                                            first_column_(std::exchange(other.first_column_, 0)),
+                                                            plane_rows_(std::exchange(other.plane_rows_, 0)),
+                                                            storage_(std::move(other.storage_)) {}
+
+PlanarBuffer &PlanarBuffer::operator=(PlanarBuffer &&other) noexcept {
+    PlanarBuffer moved(std::move(other));
+    Swap(moved);
+    return *this;
+}
+
+PlanarBuffer::~PlanarBuffer() {
+    Clear();
+}
+
+PlanarBuffer PlanarBuffer::Split(const ImageBuffer &pixels) {
+    PlanarBuffer planes(pixels.Height(), pixels.Width());
+    ParallelFor(0, planes.height_, [&planes, &pixels](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            SplitRow(pixels.Row(i), planes.width_, planes.Row(0, i), planes.Row(1, i), planes.Row(2, i));
+        }
+    });
+    return planes;
+}
+
+ImageBuffer PlanarBuffer::Merge() const {
+    ImageBuffer pixels = ScratchArena::Instance().Acquire(height_, width_);
+    ParallelFor(0, height_, [this, &pixels](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            MergeRow(Row(0, i), Row(1, i), Row(2, i), width_, pixels.Row(i));
+        }
+    });
+    return pixels;
+}
+
+PlanarBuffer PlanarBuffer::View(size_t first_row, size_t first_column, size_t height, size_t width) && {
+    PlanarBuffer view(std::move(*this));
+    view.first_row_ += first_row;
+    view.first_column_ += first_column;
+    view.height_ = height;
+    view.width_ = width;
+    return view;
+}
+
+size_t PlanarBuffer::Height() const {
+    return height_;
+}
+
+size_t PlanarBuffer::Width() const {
+    return width_;
+}
+
+size_t PlanarBuffer::Channels() const {
+    return plane_rows_ == 0 ? 0 : storage_.Height() / plane_rows_;
+}
+
+bool PlanarBuffer::Empty() const {
+    return height_ == 0 || width_ == 0;
+}
+
+uint8_t *PlanarBuffer::Row(size_t channel, size_t index) {
+    return reinterpret_cast<uint8_t *>(storage_.Row(channel * plane_rows_ + first_row_ + index)) + first_column_;
+}
+
+const uint8_t *PlanarBuffer::Row(size_t channel, size_t index) const {
+    return reinterpret_cast<const uint8_t *>(storage_.Row(channel * plane_rows_ + first_row_ + index)) + first_column_;
+}
+
+void PlanarBuffer::Clear() {
+    ScratchArena::Instance().Release(std::exchange(storage_, ImageBuffer()));
+    height_ = 0;
+    width_ = 0;
+    first_row_ = 0;
+    first_column_ = 0;
+    plane_rows_ = 0;
+}
+
+void PlanarBuffer::Swap(PlanarBuffer &other) noexcept {
+    std::swap(height_, other.height_);
+    std::swap(width_, other.width_);
+    std::swap(first_row_, other.first_row_);
+    std::swap(first_column_, other.first_column_);
+    std::swap(plane_rows_, other.plane_rows_);
+    storage_.Swap(other.storage_);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include <cstdint>
+
+enum class PixelLayout {
+    Interleaved, // B, G, R of every pixel side by side, as in BMP files (ImageBuffer)
+    Planar, // a separate plane of bytes for every channel (PlanarBuffer)
+    Any, // a filter that works as fast on either of them
+};
+
+// The three channel planes of an image, one byte per pixel each. They live one after another in an ImageBuffer
+// of 3 * height rows, so they come from and go back to the scratch arena like any other pixels. A buffer of a single
+// plane keeps the alpha bytes of 32-bit images.
+class PlanarBuffer {
+public:
+    PlanarBuffer();
+
+    PlanarBuffer(size_t height, size_t width, size_t channels = 3);
+
+    PlanarBuffer(const PlanarBuffer &other) = default;
+
+    PlanarBuffer(PlanarBuffer &&other) noexcept;
+
+    PlanarBuffer &operator=(const PlanarBuffer &other) = default;
+
+    PlanarBuffer &operator=(PlanarBuffer &&other) noexcept; // the planes replaced go back to the scratch arena
+
+    ~PlanarBuffer();
+
+    // channel 0, 1 and 2 hold what Pixel::red, green and blue hold
+    static PlanarBuffer Split(const ImageBuffer &pixels); // rows are converted in parallel
+
+    ImageBuffer Merge() const;
+
+    // bytes [first_column, first_column + width) of rows [first_row, first_row + height) of every plane, the bytes
+    // stay where they are
+    PlanarBuffer View(size_t first_row, size_t first_column, size_t height, size_t width) &&;
+
+    size_t Height() const;
+
+    size_t Width() const;
+
+    size_t Channels() const;
+
+    bool Empty() const;
+
+    uint8_t *Row(size_t channel, size_t index);
+
+    const uint8_t *Row(size_t channel, size_t index) const;
+
+    void Clear(); // gives the planes back to the scratch arena
+
+    void Swap(PlanarBuffer &other) noexcept;
+
+private:
+    size_t height_;
+    size_t width_;
+    size_t first_row_; // of the planes in storage_, non-zero for views
+    size_t first_column_;
+    size_t plane_rows_; // rows of storage_ a plane takes
+    ImageBuffer storage_;
+};
@@ -0,0 +1,175 @@
+#include "Profiler.h"
+#include <sys/resource.h>
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+size_t ThreadNumber() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t number = next++;
+    return number;
+}
+
+std::string Escaped(const std::string &text) { // for a JSON string
+    std::string escaped;
+    for (char symbol: text) {
+        if (symbol == '"' || symbol == '\\') {
+            escaped += '\\';
+        }
+        escaped += symbol;
+    }
+    return escaped;
+}
+
+}
+
+Profiler &Profiler::Instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::Start() {
+    std::lock_guard lock(mutex_);
+    records_.clear();
+    start_ = std::chrono::steady_clock::now();
+    recording_ = true;
+}
+
+void Profiler::Stop() {
+    recording_ = false;
+}
+
+void Profiler::Record(ProfileRecord record) {
+    std::lock_guard lock(mutex_);
+    records_.push_back(std::move(record));
+}
+
+std::vector<ProfileRecord> Profiler::Records() const {
+    std::lock_guard lock(mutex_);
+    return records_;
+}
+
+std::string Profiler::Summary() const {
+    struct Total {
+        size_t count = 0;
+        double wall = 0;
+        double cpu = 0;
+        size_t bytes = 0;
+        size_t allocations = 0;
+        size_t allocated_bytes = 0;
+        size_t peak_rss = 0;
+    };
+    std::map<std::pair<std::string, std::string>, Total> totals;
+    for (const auto &record: Records()) {
+        // filters are told apart by their labels, reads and writes of all files go together
+        Total &total = totals[{record.category, record.category == "filter" ? record.name : ""}];
+        ++total.count;
+        total.wall += record.wall;
+        total.cpu += record.cpu;
+        total.bytes += record.bytes;
+        total.allocations += record.allocations;
+        total.allocated_bytes += record.allocated_bytes;
+        total.peak_rss = std::max(total.peak_rss, record.peak_rss);
+    }
+    std::vector<std::pair<std::pair<std::string, std::string>, Total>> sorted(totals.begin(), totals.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto &first, const auto &second) {
+        return first.second.wall > second.second.wall;
+    });
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    for (const auto &[key, total]: sorted) {
+        out << key.first << (key.second.empty() ? "" : " \"" + key.second + "\"") << ": " << total.count << "x, "
+            << total.wall * 1e3 << " ms wall, "
+            << total.cpu * 1e3 << " ms cpu, " << static_cast<double>(total.bytes) / 1e6 / total.wall << " MB/s, "
+            << total.allocations << " allocations (" << static_cast<double>(total.allocated_bytes) / 1e6
+            << " MB), peak rss " << static_cast<double>(total.peak_rss) / 1e6 << " MB\n";
+    }
+    return out.str();
+}
+
+void Profiler::WriteTrace(const std::string &file_name) const {
+    std::ofstream out(file_name);
+    if (!out) {
+        throw std::runtime_error("Cannot open profile file\n");
+    }
+    auto records = Records();
+    out << "{\"traceEvents\": [";
+    for (size_t index = 0; index < records.size(); ++index) {
+        const auto &record = records[index];
+        out << (index == 0 ? "\n" : ",\n") << "  {\"name\": \"" << Escaped(record.name) << "\", \"cat\": \""
+            << record.category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << record.thread
+            << ", \"ts\": " << record.start * 1e6 << ", \"dur\": " << record.wall * 1e6
+            << ", \"args\": {\"cpu_us\": " << record.cpu * 1e6 << ", \"bytes\": " << record.bytes
+            << ", \"allocations\": " << record.allocations << ", \"allocated_bytes\": " << record.allocated_bytes
+            << ", \"peak_rss_bytes\": " << record.peak_rss << "}}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+ProfileScope::ProfileScope(const char *category, const std::string &name, size_t bytes)
+        : active_(Profiler::Recording()) {
+    if (!active_) {
+        return;
+    }
+    record_.category = category;
+    record_.name = name;
+    record_.thread = ThreadNumber();
+    record_.bytes = bytes;
+    record_.cpu = ProcessCpuSeconds();
+    record_.allocations = Profiler::allocations_.load(std::memory_order_relaxed);
+    record_.allocated_bytes = Profiler::allocated_bytes_.load(std::memory_order_relaxed);
+    ResetPeakRss();
+    start_ = std::chrono::steady_clock::now();
+}
+
+ProfileScope::~ProfileScope() {
+    if (!active_) {
+        return;
+    }
+    Profiler &profiler = Profiler::Instance();
+    record_.start = std::chrono::duration<double>(start_ - profiler.start_).count();
+    record_.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    record_.cpu = ProcessCpuSeconds() - record_.cpu;
+    record_.allocations = Profiler::allocations_.load(std::memory_order_relaxed) - record_.allocations;
+    record_.allocated_bytes = Profiler::allocated_bytes_.load(std::memory_order_relaxed) - record_.allocated_bytes;
+    record_.peak_rss = PeakRss();
+    profiler.Record(std::move(record_));
+}
+
+void ProfileScope::AddBytes(size_t bytes) {
+    record_.bytes += bytes;
+}
+
+double ProcessCpuSeconds() {
+    timespec time{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+}
+
+void ResetPeakRss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if (clear_refs) {
+        clear_refs << "5";
+    }
+}
+
+size_t PeakRss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with("VmHWM:")) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileRecord { // one stage: reading or writing a file, or one filter over an image or a band
+    std::string category; // "read", "filter" or "write"
+    std::string name; // file name or filter label
+    size_t thread; // small number of the thread that ran the stage
+    double start; // seconds since the profiler started
+    double wall; // seconds
+    double cpu; // seconds of CPU time of the whole process, thread pool included
+    size_t bytes; // bytes of pixels or of the file the stage went through
+    size_t allocations; // pixel buffers allocated while the stage ran
+    size_t allocated_bytes;
+    size_t peak_rss; // peak resident memory of the process while the stage ran
+};
+
+// Opt-in timing and memory instrumentation of reads, filters and writes. Stages that are not recording cost one
+// relaxed atomic load. Allocations and CPU time are counted for the whole process, so stages that run at the same
+// time (bands of a pipeline, images of a batch) see each other's.
+class Profiler {
+public:
+    static Profiler &Instance();
+
+    void Start(); // drops the old records, called before any stage runs
+
+    void Stop();
+
+    static bool Recording() {
+        return recording_.load(std::memory_order_relaxed);
+    }
+
+    static void CountAllocation(size_t bytes) { // called for every pixel buffer
+        if (Recording()) {
+            allocations_.fetch_add(1, std::memory_order_relaxed);
+            allocated_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    void Record(ProfileRecord record);
+
+    std::vector<ProfileRecord> Records() const;
+
+    // filters with the same label added up, as well as all reads and all writes, slowest first, one line each
+    std::string Summary() const;
+
+    // every record as a complete event in the Chrome trace event format (chrome://tracing, Perfetto)
+    void WriteTrace(const std::string &file_name) const;
+
+private:
+    friend class ProfileScope;
+
+    static inline std::atomic<bool> recording_{false};
+    static inline std::atomic<size_t> allocations_{0};
+    static inline std::atomic<size_t> allocated_bytes_{0};
+
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<ProfileRecord> records_;
+};
+
+class ProfileScope { // records the stage from construction to destruction if the profiler is recording
+public:
+    ProfileScope(const char *category, const std::string &name, size_t bytes = 0);
+
+    ProfileScope(const ProfileScope &other) = delete;
+
+    ProfileScope &operator=(const ProfileScope &other) = delete;
+
+    ~ProfileScope();
+
+    void AddBytes(size_t bytes); // for stages that learn their size on the way
+
+private:
+    bool active_;
+    ProfileRecord record_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+double ProcessCpuSeconds();
+
+// Linux keeps the peak in VmHWM and resets it on request, other systems only report the peak of the whole process
+void ResetPeakRss();
+
+size_t PeakRss();
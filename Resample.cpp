@@ -0,0 +1,242 @@
+#include "Resample.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+namespace {
+
+const double kLanczosLobes = 3;
+
+double Lanczos(double x) {
+    x = std::abs(x);
+    if (x >= kLanczosLobes) {
+        return 0;
+    }
+    if (x < 1e-9) {
+        return 1;
+    }
+    double angle = std::numbers::pi * x;
+    return kLanczosLobes * std::sin(angle) * std::sin(angle / kLanczosLobes) / (angle * angle);
+}
+
+double CatmullRom(double x) { // the cubic convolution kernel with a = -0.5
+    x = std::abs(x);
+    if (x < 1) {
+        return (1.5 * x - 2.5) * x * x + 1;
+    }
+    return x < 2 ? ((-0.5 * x + 2.5) * x - 4) * x + 2 : 0;
+}
+
+double Box(double x) {
+    return x >= -0.5 && x < 0.5 ? 1 : 0;
+}
+
+double Support(ResampleMethod method) { // half the width of the kernel at scale 1
+    switch (method) {
+        case ResampleMethod::Lanczos:
+            return kLanczosLobes;
+        case ResampleMethod::Bicubic:
+            return 2;
+        default:
+            return 0.5;
+    }
+}
+
+double Weigh(ResampleMethod method, double x) {
+    switch (method) {
+        case ResampleMethod::Lanczos:
+            return Lanczos(x);
+        case ResampleMethod::Bicubic:
+            return CatmullRom(x);
+        default:
+            return Box(x);
+    }
+}
+
+// Rows of channels bytes per pixel. Rows are reached through vectors of pointers, so interleaved pixels, planes
+// and views of either go through the same passes, and the rows under a vertical window are consecutive entries.
+using SourceRows = std::vector<const uint8_t *>;
+using TargetRows = std::vector<uint8_t *>;
+
+void ResampleHorizontally(const SourceRows &source, const TargetRows &target, size_t channels,
+                          const ResampleWeights &weights) {
+    size_t width = weights.first.size();
+    ParallelFor(0, source.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            ResampleRow(source[i], channels, weights.first.data(), weights.weights.data(), weights.taps, width,
+                        target[i]);
+        }
+    });
+}
+
+void ResampleVertically(const SourceRows &source, const TargetRows &target, size_t length,
+                        const ResampleWeights &weights) {
+    ParallelFor(0, target.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            ResampleColumns(source.data() + weights.first[i], weights.weights.data() + i * weights.taps,
+                            weights.taps, length, target[i]);
+        }
+    });
+}
+
+bool IsBlockMean(size_t source_height, size_t source_width, size_t height, size_t width, ResampleMethod method) {
+    if (method != ResampleMethod::Box || source_height == 0 || source_width == 0 || source_height % height != 0 ||
+        source_width % width != 0) { // an empty source divides evenly but has no blocks to average
+        return false;
+    }
+    return source_height / height * (source_width / width) < kMaxBoxWindow;
+}
+
+// target pixel (i, j) = the mean of the block of source pixels it covers, the size of the source a whole multiple of
+// the size of the target
+void BlockMeans(const SourceRows &source, size_t source_width, const TargetRows &target, size_t width,
+                size_t channels) {
+    size_t block_height = source.size() / target.size();
+    size_t block_width = source_width / width;
+    uint32_t reciprocal = BoxReciprocal(block_height * block_width);
+    size_t length = width * channels;
+    ParallelFor(0, target.size(), [&](size_t begin, size_t end) {
+        std::vector<uint32_t> sums(length);
+        for (size_t i = begin; i < end; ++i) {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (size_t row = i * block_height; row < (i + 1) * block_height; ++row) {
+                const uint8_t *bytes = source[row];
+                for (size_t j = 0; j < width; ++j) {
+                    uint32_t *pixel_sums = sums.data() + j * channels;
+                    for (size_t k = 0; k < block_width; ++k, bytes += channels) {
+                        for (size_t channel = 0; channel < channels; ++channel) {
+                            pixel_sums[channel] += bytes[channel];
+                        }
+                    }
+                }
+            }
+            ScaleSums(sums.data(), length, reciprocal, target[i]);
+        }
+    });
+}
+
+// the passes a change of size needs, a pass that keeps the size is skipped; scratch rows take the result of the
+// horizontal pass if both are needed
+void ResampleRows(const SourceRows &source, size_t source_width, const TargetRows &scratch, const TargetRows &target,
+                  size_t width, size_t channels, ResampleMethod method) {
+    bool horizontal = source_width != width;
+    bool vertical = source.size() != target.size();
+    if (!horizontal && !vertical) {
+        for (size_t i = 0; i < source.size(); ++i) {
+            std::memcpy(target[i], source[i], width * channels);
+        }
+        return;
+    }
+    if (IsBlockMean(source.size(), source_width, target.size(), width, method)) {
+        BlockMeans(source, source_width, target, width, channels);
+        return;
+    }
+    if (horizontal) {
+        ResampleHorizontally(source, vertical ? scratch : target, channels,
+                             MakeResampleWeights(source_width, width, method));
+    }
+    if (vertical) {
+        ResampleVertically(horizontal ? SourceRows(scratch.begin(), scratch.end()) : source, target,
+                           width * channels, MakeResampleWeights(source.size(), target.size(), method));
+    }
+}
+
+bool NeedsScratch(size_t source_height, size_t source_width, size_t height, size_t width, ResampleMethod method) {
+    return source_height != height && source_width != width &&
+           !IsBlockMean(source_height, source_width, height, width, method);
+}
+
+}
+
+ResampleWeights MakeResampleWeights(size_t source_size, size_t target_size, ResampleMethod method) {
+    double scale = static_cast<double>(source_size) / static_cast<double>(target_size);
+    double stretch = std::max(scale, 1.0); // of the kernel, shrinking has to average every source pixel
+    double support = Support(method) * stretch;
+
+    ResampleWeights result;
+    result.taps = std::min(source_size, 2 * static_cast<size_t>(std::ceil(support)) + 1);
+    result.first.resize(target_size);
+    result.weights.assign(target_size * result.taps, 0);
+    std::vector<double> window(result.taps);
+    for (size_t i = 0; i < target_size; ++i) {
+        double center = (static_cast<double>(i) + 0.5) * scale;
+        auto begin = static_cast<size_t>(std::max(0.0, std::floor(center - support + 0.5)));
+        auto end = std::min(source_size, static_cast<size_t>(std::max(0.0, std::floor(center + support + 0.5))));
+        end = std::min(end, begin + result.taps);
+        size_t first = std::min(begin, source_size - result.taps);
+        result.first[i] = static_cast<uint32_t>(first);
+
+        std::fill(window.begin(), window.end(), 0.0);
+        double total = 0;
+        for (size_t x = begin; x < end; ++x) {
+            window[x - first] = Weigh(method, (static_cast<double>(x) + 0.5 - center) / stretch);
+            total += window[x - first];
+        }
+        if (total == 0) {
+            continue;
+        }
+        // rounded weights may add up to a little more or less than 1, the difference goes to the largest one
+        int16_t *weights = result.weights.data() + i * result.taps;
+        int32_t sum = 0;
+        size_t largest = 0;
+        for (size_t k = 0; k < result.taps; ++k) {
+            weights[k] = static_cast<int16_t>(std::lround(window[k] / total * (1 << kResampleShift)));
+            sum += weights[k];
+            largest = std::abs(weights[k]) > std::abs(weights[largest]) ? k : largest;
+        }
+        weights[largest] = static_cast<int16_t>(weights[largest] + (1 << kResampleShift) - sum);
+    }
+    return result;
+}
+
+ImageBuffer Resample(const ImageBuffer &source, size_t height, size_t width, ResampleMethod method) {
+    ScratchArena &arena = ScratchArena::Instance();
+    ImageBuffer target = arena.Acquire(height, width);
+    ImageBuffer scratch;
+    if (NeedsScratch(source.Height(), source.Width(), height, width, method)) {
+        scratch = arena.Acquire(source.Height(), width);
+    }
+    SourceRows source_rows(source.Height());
+    TargetRows scratch_rows(scratch.Height());
+    TargetRows target_rows(height);
+    for (size_t i = 0; i < source_rows.size(); ++i) {
+        source_rows[i] = reinterpret_cast<const uint8_t *>(source.Row(i));
+    }
+    for (size_t i = 0; i < scratch_rows.size(); ++i) {
+        scratch_rows[i] = reinterpret_cast<uint8_t *>(scratch.Row(i));
+    }
+    for (size_t i = 0; i < target_rows.size(); ++i) {
+        target_rows[i] = reinterpret_cast<uint8_t *>(target.Row(i));
+    }
+    ResampleRows(source_rows, source.Width(), scratch_rows, target_rows, width, sizeof(Pixel), method);
+    arena.Release(std::move(scratch));
+    return target;
+}
+
+PlanarBuffer Resample(const PlanarBuffer &source, size_t height, size_t width, ResampleMethod method) {
+    PlanarBuffer target(height, width, source.Channels());
+    PlanarBuffer scratch;
+    if (NeedsScratch(source.Height(), source.Width(), height, width, method)) {
+        scratch = PlanarBuffer(source.Height(), width, 1); // reused by every plane
+    }
+    SourceRows source_rows(source.Height());
+    TargetRows scratch_rows(scratch.Height());
+    TargetRows target_rows(height);
+    for (size_t i = 0; i < scratch_rows.size(); ++i) {
+        scratch_rows[i] = scratch.Row(0, i);
+    }
+    for (size_t channel = 0; channel < source.Channels(); ++channel) {
+        for (size_t i = 0; i < source_rows.size(); ++i) {
+            source_rows[i] = source.Row(channel, i);
+        }
+        for (size_t i = 0; i < target_rows.size(); ++i) {
+            target_rows[i] = target.Row(channel, i);
+        }
+        ResampleRows(source_rows, source.Width(), scratch_rows, target_rows, width, 1, method);
+    }
+    return target;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include "PlanarBuffer.h"
+#include <cstdint>
+#include <vector>
+
+// Resampling engine. Images are resized in two separable passes, first every source row to the target width,
+// then the columns of those rows to the target height, each pass parallel over the rows it writes. A target pixel
+// is a weighted sum of the source pixels under its kernel; the kernel is stretched by the scale when shrinking, so
+// every source pixel contributes. Weights are computed once per target column and once per target row, the inner
+// loops are integer multiply-adds (see ResampleColumns and ResampleRow in PixelKernels.h). Source pixels past the
+// edges are left out and the remaining weights renormalized.
+
+enum class ResampleMethod {
+    Lanczos, // windowed sinc with 3 lobes, the sharpest
+    Bicubic, // Catmull-Rom
+    Box, // the mean of the covered source pixels, nearest neighbour when enlarging
+};
+
+struct ResampleWeights { // target pixel i = sum of weights[i * taps + k] * source pixel first[i] + k over k < taps
+    size_t taps = 0;
+    std::vector<uint32_t> first;
+    std::vector<int16_t> weights; // in 1/2^kResampleShift, every target pixel's ones add up to exactly 1
+};
+
+// windows that would cross the end of the source are moved back inside it, with zero weights for the extra taps
+ResampleWeights MakeResampleWeights(size_t source_size, size_t target_size, ResampleMethod method);
+
+// box resampling by whole factors in both directions is a block mean in a single pass, with the arithmetic of the
+// box blur (see BoxReciprocal); everything else goes through the two weighted passes
+ImageBuffer Resample(const ImageBuffer &source, size_t height, size_t width, ResampleMethod method);
+
+PlanarBuffer Resample(const PlanarBuffer &source, size_t height, size_t width, ResampleMethod method); // every plane
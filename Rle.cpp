@@ -0,0 +1,125 @@
+#include "Rle.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const uint8_t kEndOfRow = 0;
+const uint8_t kEndOfImage = 1;
+const uint8_t kDelta = 2;
+
+const size_t kMaxRun = 255;
+const size_t kMinLiteral = 3; // literal runs of 1 or 2 values would be read as escapes
+
+}
+
+RleDecoder::RleDecoder(uint16_t bits_per_pixel, size_t width)
+        : bits_per_pixel_(bits_per_pixel), width_(width), skipped_rows_(0), first_column_(0), finished_(false) {}
+
+std::optional<size_t> RleDecoder::DecodeRow(const uint8_t *data, size_t size, uint8_t *indices) {
+    std::memset(indices, 0, width_);
+    if (finished_ || skipped_rows_ > 0) {
+        skipped_rows_ -= skipped_rows_ > 0 ? 1 : 0;
+        return 0;
+    }
+    // pixels past the width are dropped, a broken file gives a broken picture, but never a write out of the row
+    auto put = [this, indices](size_t column, uint8_t index) {
+        if (column < width_) {
+            indices[column] = index;
+        }
+    };
+    size_t column = first_column_;
+    size_t position = 0;
+    while (true) {
+        if (position + 2 > size) {
+            return std::nullopt;
+        }
+        uint8_t count = data[position];
+        uint8_t value = data[position + 1];
+        if (count > 0) { // a run, RLE4 runs alternate the two nibbles of the value
+            for (size_t k = 0; k < count; ++k) {
+                put(column + k, bits_per_pixel_ == 8 ? value : (k % 2 == 0 ? value >> 4 : value & 0x0F));
+            }
+            column += count;
+            position += 2;
+        } else if (value == kEndOfRow || value == kEndOfImage) {
+            finished_ = value == kEndOfImage;
+            first_column_ = 0;
+            return position + 2;
+        } else if (value == kDelta) {
+            if (position + 4 > size) {
+                return std::nullopt;
+            }
+            column += data[position + 2];
+            size_t rows = data[position + 3];
+            position += 4;
+            if (rows > 0) { // the row ends here, the next ones are skipped up to the new position
+                skipped_rows_ = rows - 1;
+                first_column_ = column;
+                return position;
+            }
+        } else { // literal values, padded to a whole number of 2-byte words
+            size_t bytes = bits_per_pixel_ == 8 ? value : (value + 1) / 2;
+            size_t padded = (bytes + 1) / 2 * 2;
+            if (position + 2 + padded > size) {
+                return std::nullopt;
+            }
+            const uint8_t *literal = data + position + 2;
+            for (size_t k = 0; k < value; ++k) {
+                put(column + k, bits_per_pixel_ == 8 ? literal[k] : (k % 2 == 0 ? literal[k / 2] >> 4
+                                                                                 : literal[k / 2] & 0x0F));
+            }
+            column += value;
+            position += 2 + padded;
+        }
+    }
+}
+
+size_t EncodeRle8Row(const uint8_t *values, size_t width, size_t step, uint8_t *target) {
+    auto at = [values, step](size_t index) {
+        return values[index * step];
+    };
+    size_t written = 0;
+    size_t column = 0;
+    while (column < width) {
+        size_t run = 1;
+        while (column + run < width && run < kMaxRun && at(column + run) == at(column)) {
+            ++run;
+        }
+        if (run > 1) {
+            target[written++] = run;
+            target[written++] = at(column);
+            column += run;
+            continue;
+        }
+        // values up to the next run of 2 go out as one literal run
+        size_t literal = 1;
+        while (column + literal < width && literal < kMaxRun &&
+               (column + literal + 1 == width || at(column + literal) != at(column + literal + 1))) {
+            ++literal;
+        }
+        if (literal < kMinLiteral) {
+            for (size_t k = 0; k < literal; ++k) {
+                target[written++] = 1;
+                target[written++] = at(column + k);
+            }
+        } else {
+            target[written++] = 0;
+            target[written++] = literal;
+            for (size_t k = 0; k < literal; ++k) {
+                target[written++] = at(column + k);
+            }
+            if (literal % 2 == 1) {
+                target[written++] = 0;
+            }
+        }
+        column += literal;
+    }
+    target[written++] = 0;
+    target[written++] = kEndOfRow;
+    return written;
+}
+
+size_t MaxRle8Row(size_t width) {
+    return 2 * width + 2; // no run or literal run takes more than 2 bytes per value
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Run-length encoded BMP pixels (compression methods BI_RLE8 and BI_RLE4). Rows are stored bottom-up as runs
+// "count, index", literal runs "0, count, indices..." padded to 2 bytes, and escapes "0, 0" (end of row),
+// "0, 1" (end of image) and "0, 2, dx, dy" (skip pixels and rows). Skipped pixels get index 0.
+
+// decodes rows one after another, as they come in the file
+class RleDecoder {
+public:
+    RleDecoder(uint16_t bits_per_pixel, size_t width); // 8 or 4 bits per pixel
+
+    // decodes the next row into width indices from the compressed bytes [data, data + size) that follow the ones
+    // the previous rows used; returns the number of bytes used, or nothing if the row goes on past size (then the
+    // decoder is left as it was and the row can be decoded again from more bytes)
+    std::optional<size_t> DecodeRow(const uint8_t *data, size_t size, uint8_t *indices);
+
+private:
+    uint16_t bits_per_pixel_;
+    size_t width_;
+    size_t skipped_rows_; // rows of zeros left by a "0, 2, dx, dy" escape
+    size_t first_column_; // where the row after a skip starts
+    bool finished_; // the end of the image was reached, the remaining rows are zeros
+};
+
+// encodes a row of width values read every step bytes as BI_RLE8 with its end of row escape, target must hold
+// MaxRle8Row(width) bytes; returns the number of bytes written
+size_t EncodeRle8Row(const uint8_t *values, size_t width, size_t step, uint8_t *target);
+
+size_t MaxRle8Row(size_t width);
@@ -0,0 +1,99 @@
+#include "ScratchArena.h"
+#include <utility>
+
+ScratchArena &ScratchArena::Instance() {
+    static ScratchArena arena;
+    return arena;
+}
+
+ImageBuffer ScratchArena::Acquire(size_t height, size_t width) {
+    size_t stride = (width * sizeof(Pixel) + ImageBuffer::kRowAlignment - 1) / ImageBuffer::kRowAlignment *
+                    ImageBuffer::kRowAlignment;
+    size_t size = height * stride;
+    if (size == 0) {
+        return {height, width};
+    }
+    ImageBuffer buffer;
+    {
+        std::lock_guard lock(mutex_);
+        auto best = buffers_.rend();
+        for (auto it = buffers_.rbegin(); it != buffers_.rend(); ++it) { // the most recent one is likely in cache
+            if (it->Capacity() >= size && (best == buffers_.rend() || it->Capacity() < best->Capacity())) {
+                best = it;
+            }
+        }
+        if (best == buffers_.rend()) {
+            return {height, width};
+        }
+        buffer = std::move(*best);
+        buffers_.erase(std::next(best).base());
+        idle_bytes_ -= buffer.Capacity();
+    }
+    if (buffer.IsView() || buffer.Height() != height || buffer.Width() != width || buffer.Stride() != stride) {
+        buffer.Reshape(height, width);
+    }
+    return buffer;
+}
+
+void ScratchArena::Release(ImageBuffer buffer) {
+    if (buffer.Capacity() == 0) { // borrowed and empty buffers have no allocation of their own
+        return;
+    }
+    std::lock_guard lock(mutex_);
+    idle_bytes_ += buffer.Capacity();
+    buffers_.push_back(std::move(buffer));
+    Trim();
+}
+
+std::vector<uint32_t> ScratchArena::AcquireWords(size_t count) {
+    std::vector<uint32_t> words;
+    {
+        std::lock_guard lock(mutex_);
+        auto best = words_.end();
+        for (auto it = words_.begin(); it != words_.end(); ++it) {
+            if (it->capacity() >= count && (best == words_.end() || it->capacity() < best->capacity())) {
+                best = it;
+            }
+        }
+        if (best != words_.end()) {
+            words = std::move(*best);
+            words_.erase(best);
+            idle_bytes_ -= words.capacity() * sizeof(uint32_t);
+        }
+    }
+    words.resize(count); // idle vectors keep their size, so only a larger one is partly zeroed
+    return words;
+}
+
+void ScratchArena::Release(std::vector<uint32_t> words) {
+    if (words.capacity() == 0) {
+        return;
+    }
+    std::lock_guard lock(mutex_);
+    idle_bytes_ += words.capacity() * sizeof(uint32_t);
+    words_.push_back(std::move(words));
+    Trim();
+}
+
+void ScratchArena::Clear() {
+    std::lock_guard lock(mutex_);
+    buffers_.clear();
+    words_.clear();
+    idle_bytes_ = 0;
+}
+
+size_t ScratchArena::IdleBytes() {
+    std::lock_guard lock(mutex_);
+    return idle_bytes_;
+}
+
+void ScratchArena::Trim() {
+    while (idle_bytes_ > kMaxIdleBytes && !buffers_.empty()) {
+        idle_bytes_ -= buffers_.front().Capacity();
+        buffers_.pop_front();
+    }
+    while (idle_bytes_ > kMaxIdleBytes && !words_.empty()) {
+        idle_bytes_ -= words_.front().capacity() * sizeof(uint32_t);
+        words_.pop_front();
+    }
+}
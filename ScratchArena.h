@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Pool of image-sized buffers for the temporary and result pixels of filters, and for their per-pixel tables
+// (sums, labels). A filter takes a buffer, and whatever it drops goes back, so a chain of filters, the bands of a
+// pipeline and the images of a batch keep reusing the same memory: after the first image or band of a size nothing
+// image-sized is allocated any more. Any idle allocation that is large enough is reused, so images of a batch
+// that get smaller don't allocate either. Buffers come back with arbitrary contents.
+class ScratchArena {
+public:
+    static constexpr size_t kMaxIdleBytes = size_t{1} << 30; // the oldest idle buffers are freed beyond these
+
+    static ScratchArena &Instance(); // the arena shared by all filters and pipelines
+
+    ScratchArena() = default;
+
+    ScratchArena(const ScratchArena &other) = delete;
+
+    ScratchArena &operator=(const ScratchArena &other) = delete;
+
+    // the same as ImageBuffer(height, width), but in the smallest idle allocation that fits
+    ImageBuffer Acquire(size_t height, size_t width);
+
+    void Release(ImageBuffer buffer); // views give back their whole allocation, borrowed buffers are just dropped
+
+    std::vector<uint32_t> AcquireWords(size_t count); // count words, reusing the smallest idle vector that fits
+
+    void Release(std::vector<uint32_t> words);
+
+    void Clear(); // frees every idle buffer
+
+    size_t IdleBytes();
+
+private:
+    void Trim(); // frees the oldest idle buffers, then the oldest vectors, until kMaxIdleBytes are left
+
+    std::mutex mutex_;
+    size_t idle_bytes_ = 0;
+    std::deque<ImageBuffer> buffers_;
+    std::deque<std::vector<uint32_t>> words_;
+};
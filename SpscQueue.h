@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Bounded queue between one producer thread and one consumer thread. Items move through a ring of slots without
+// locks; a side that finds the ring full or empty sleeps on an atomic wait until the other side makes progress.
+template <class T>
+class SpscQueue {
+public:
+    SpscQueue(size_t capacity) : slots_(capacity == 0 ? 1 : capacity) {}
+
+    SpscQueue(const SpscQueue &other) = delete;
+
+    SpscQueue &operator=(const SpscQueue &other) = delete;
+
+    bool Push(T item) { // false if the queue has been closed, the item is dropped then
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t seen = events_.load(std::memory_order_acquire);
+            if (closed_.load(std::memory_order_acquire)) {
+                return false;
+            } else if (tail - head_.load(std::memory_order_acquire) < slots_.size()) {
+                break;
+            }
+            events_.wait(seen, std::memory_order_acquire);
+        }
+        slots_[tail % slots_.size()] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        Signal();
+        return true;
+    }
+
+    bool Pop(T &item) { // false once the queue is closed and every pushed item has been popped
+        size_t head = head_.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t seen = events_.load(std::memory_order_acquire);
+            if (tail_.load(std::memory_order_acquire) != head) {
+                break;
+            } else if (closed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            events_.wait(seen, std::memory_order_acquire);
+        }
+        item = std::move(slots_[head % slots_.size()]);
+        head_.store(head + 1, std::memory_order_release);
+        Signal();
+        return true;
+    }
+
+    void Close() { // wakes both sides: the producer stops, the consumer gets what is left
+        closed_.store(true, std::memory_order_release);
+        Signal();
+    }
+
+private:
+    void Signal() { // every change bumps the counter, so a side that checked the ring before it cannot miss it
+        events_.fetch_add(1, std::memory_order_acq_rel);
+        events_.notify_all();
+    }
+
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_{0}; // written by the consumer only
+    alignas(64) std::atomic<size_t> tail_{0}; // written by the producer only
+    alignas(64) std::atomic<uint32_t> events_{0};
+    std::atomic<bool> closed_{false};
+};
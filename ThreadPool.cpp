@@ -0,0 +1,152 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+
+struct ParallelForState {
+    size_t begin;
+    size_t end;
+    size_t chunk;
+    size_t chunks;
+    const std::function<void(size_t, size_t)> *body;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+
+    void Run() { // takes chunks until none are left, helpers starting late find nothing to do
+        for (size_t index = next++; index < chunks; index = next++) {
+            size_t from = begin + index * chunk;
+            size_t to = std::min(end, from + chunk);
+            try {
+                (*body)(from, to);
+            } catch (...) {
+                std::lock_guard lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            if (++done == chunks) {
+                std::lock_guard lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+ThreadPool &ThreadPool::Instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool(size_t threads) : threads_(1), stopping_(false) {
+    Start(threads);
+}
+
+ThreadPool::~ThreadPool() {
+    Stop();
+}
+
+void ThreadPool::SetThreads(size_t threads) {
+    Stop();
+    Start(threads);
+}
+
+size_t ThreadPool::Threads() const {
+    return threads_;
+}
+
+void ThreadPool::Start(size_t threads) {
+    if (threads == 0) {
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    threads_ = threads;
+    stopping_ = false;
+    for (size_t i = 1; i < threads_; ++i) { // the caller of ParallelFor is the remaining thread
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+void ThreadPool::Stop() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (auto &worker: workers_) {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)> &body,
+                             size_t grain) {
+    if (begin >= end) {
+        return;
+    }
+    size_t length = end - begin;
+    grain = std::max<size_t>(grain, 1);
+    // a few chunks per thread even out rows that take different time
+    size_t chunks = std::min((length + grain - 1) / grain, threads_ * 4);
+    if (chunks <= 1 || workers_.empty()) {
+        body(begin, end);
+        return;
+    }
+
+    auto state = std::make_shared<ParallelForState>();
+    state->begin = begin;
+    state->end = end;
+    state->chunk = (length + chunks - 1) / chunks;
+    state->chunks = (length + state->chunk - 1) / state->chunk;
+    state->body = &body;
+
+    size_t helpers = std::min(workers_.size(), state->chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        Submit([state] { state->Run(); });
+    }
+    state->Run();
+
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock, [&state] { return state->done == state->chunks; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+void ParallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)> &body, size_t grain) {
+    ThreadPool::Instance().ParallelFor(begin, end, body, grain);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    static ThreadPool &Instance(); // the pool shared by all filters
+
+    ThreadPool(size_t threads = 0);
+
+    ThreadPool(const ThreadPool &other) = delete;
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    ~ThreadPool();
+
+    void SetThreads(size_t threads); // 0 means one thread per hardware thread
+
+    size_t Threads() const; // including the thread that calls ParallelFor
+
+    void Submit(std::function<void()> task);
+
+    // calls body(from, to) for disjoint subranges covering [begin, end) and waits for all of them,
+    // the calling thread takes part in the work, so nested calls from pool threads cannot deadlock
+    void ParallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)> &body, size_t grain = 1);
+
+private:
+    void Start(size_t threads);
+
+    void Stop();
+
+    void WorkerLoop();
+
+    size_t threads_;
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_;
+};
+
+// shortcut for ThreadPool::Instance().ParallelFor
+void ParallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)> &body, size_t grain = 1);
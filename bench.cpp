@@ -0,0 +1,243 @@
+#include "FilterFactory.h"
+#include "PixelKernels.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Throughput benchmark: generates synthetic BMPs, times reading, writing, every filter and a few common chains on
+// them, and prints the results as JSON. Files live in the temporary directory, so reads are from a warm page cache.
+//
+// bmp_editor_bench [--sizes 1,10,50,200] [--repeat N] [--threads N] [--only substring] [--output file.json]
+
+namespace {
+
+struct BenchOptions {
+    std::vector<size_t> sizes = {1, 10, 50, 200}; // in megapixels
+    size_t repeat = 3; // the fastest of the runs is reported
+    size_t threads = 0;
+    std::string only; // runs only operations containing this substring
+    std::string output; // stdout if empty
+};
+
+struct BenchResult {
+    size_t megapixels;
+    size_t width;
+    size_t height;
+    std::string operation;
+    double seconds;
+    size_t bytes; // bytes of pixels read, written or filtered
+    size_t peak_rss; // peak resident memory during the fastest run
+};
+
+std::vector<size_t> ParseSizes(const std::string &list) {
+    std::vector<size_t> sizes;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t size = std::stoull(item);
+        if (size == 0) {
+            throw std::runtime_error("Image sizes must be positive numbers of megapixels\n");
+        }
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+BenchOptions ParseOptions(int argc, const char *argv[]) {
+    BenchOptions options;
+    for (int index = 1; index < argc; ++index) {
+        std::string argument = argv[index];
+        if (index + 1 == argc) {
+            throw std::runtime_error(argument + " option needs a value\n");
+        }
+        std::string value = argv[++index];
+        if (argument == "--sizes") {
+            options.sizes = ParseSizes(value);
+        } else if (argument == "--repeat") {
+            options.repeat = std::max<size_t>(1, std::stoull(value));
+        } else if (argument == "--threads") {
+            options.threads = std::stoull(value);
+        } else if (argument == "--only") {
+            options.only = value;
+        } else if (argument == "--output") {
+            options.output = value;
+        } else {
+            throw std::runtime_error("Unknown option " + argument + "\n");
+        }
+    }
+    return options;
+}
+
+Image MakeImage(size_t width, size_t height) { // smooth gradients with some noise, so no filter takes a shortcut
+    ImageBuffer pixels(height, width);
+    uint32_t state = 2463534242;
+    for (size_t i = 0; i < height; ++i) {
+        Pixel *row = pixels.Row(i);
+        for (size_t j = 0; j < width; ++j) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            row[j] = Pixel{static_cast<uint8_t>(j * 255 / width + (state & 15)),
+                           static_cast<uint8_t>(i * 255 / height + (state >> 4 & 15)),
+                           static_cast<uint8_t>((i + j) & 255)};
+        }
+    }
+    BMPHeaders headers{};
+    headers.file_type = 0x4D42;
+    headers.offset = sizeof(BMPHeaders);
+    headers.DIBHeader_size = sizeof(DIBHeader);
+    headers.color_planes = 1;
+    headers.bits_per_pixel = 24;
+    headers.horizontal_resolution = 2835;
+    headers.vertical_resolution = 2835;
+    return {headers, std::move(pixels)};
+}
+
+class Bench {
+public:
+    explicit Bench(const BenchOptions &options) : options_(options) {}
+
+    void Run(size_t megapixels, const std::string &operation, size_t width, size_t height, size_t bytes,
+             const std::function<void()> &prepare, const std::function<void()> &body) {
+        if (!options_.only.empty() && operation.find(options_.only) == std::string::npos) {
+            return;
+        }
+        BenchResult best{megapixels, width, height, operation, INFINITY, bytes, 0};
+        for (size_t run = 0; run < options_.repeat; ++run) {
+            prepare();
+            ResetPeakRss();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() < best.seconds) {
+                best.seconds = elapsed.count();
+                best.peak_rss = PeakRss();
+            }
+        }
+        std::cerr << operation << " " << megapixels << " MP: " << best.seconds << " s\n";
+        results_.push_back(best);
+    }
+
+    void Print(std::ostream &out) const {
+        out << "{\n  \"kernels\": \"" << PixelKernelsName() << "\",\n  \"threads\": "
+            << ThreadPool::Instance().Threads() << ",\n  \"repeat\": " << options_.repeat << ",\n  \"runs\": [";
+        for (size_t index = 0; index < results_.size(); ++index) {
+            const auto &result = results_[index];
+            double pixels = static_cast<double>(result.width * result.height);
+            out << (index == 0 ? "\n" : ",\n") << "    {\"operation\": \"" << result.operation
+                << "\", \"megapixels\": " << result.megapixels << ", \"width\": " << result.width
+                << ", \"height\": " << result.height << ", \"seconds\": " << result.seconds
+                << ", \"megapixels_per_second\": " << pixels / 1e6 / result.seconds
+                << ", \"bytes_per_second\": " << static_cast<double>(result.bytes) / result.seconds
+                << ", \"peak_rss_bytes\": " << result.peak_rss << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+private:
+    const BenchOptions &options_;
+    std::vector<BenchResult> results_;
+};
+
+std::vector<std::string> SplitWords(const std::string &line) {
+    std::vector<std::string> words;
+    std::stringstream stream(line);
+    std::string word;
+    while (stream >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+std::vector<FilterInfo> ToFilters(const std::string &line) { // "-gs -blur 2" -> {{"-gs", {}}, {"-blur", {"2"}}}
+    std::vector<FilterInfo> filters;
+    for (const auto &word: SplitWords(line)) {
+        if (word[0] == '-' && !std::isdigit(static_cast<unsigned char>(word[1]))) {
+            filters.push_back({word, {}});
+        } else {
+            filters.back().params.push_back(word);
+        }
+    }
+    return filters;
+}
+
+std::vector<std::string> BenchChains(size_t width, size_t height) {
+    std::string half_crop = "-crop " + std::to_string(width / 2) + " " + std::to_string(height / 2);
+    return {
+            // every filter on its own
+            half_crop, "-gs", "-neg", "-sharp", "-edge 0.1", "-blur 2", "-box 2", "-conv 3 1 2 1 2 4 2 1 2 1",
+            "-contr", "-gamma 0.8", "-pixel 4", "-crystal 32 1",
+            // common chains
+            "-gs -neg -gamma 0.8 -sharp", "-contr -gamma 0.5 -neg", "-sharp -contr", "-gs -edge 0.2",
+            half_crop + " -blur 1.5", "-blur 3 -sharp -gamma 0.9",
+    };
+}
+
+void BenchSize(Bench &bench, size_t megapixels) {
+    auto width = static_cast<size_t>(std::sqrt(megapixels * 1e6 * 4 / 3)); // 4:3 like a photo
+    size_t height = megapixels * 1000000 / width;
+    size_t pixel_bytes = width * height * sizeof(Pixel);
+
+    auto directory = std::filesystem::temp_directory_path();
+    std::string input = (directory / ("bmp_editor_bench_" + std::to_string(megapixels) + ".bmp")).string();
+    std::string output = (directory / ("bmp_editor_bench_" + std::to_string(megapixels) + "_out.bmp")).string();
+
+    Image source = MakeImage(width, height);
+    source.Write(input);
+    size_t file_size = std::filesystem::file_size(input);
+    auto nothing = []() {};
+
+    std::unique_ptr<Image> image;
+    bench.Run(megapixels, "read stream", width, height, file_size, nothing,
+              [&image, &input]() { image = std::make_unique<Image>(input, ReadMode::Stream); });
+    bench.Run(megapixels, "read mapped", width, height, file_size, nothing,
+              [&image, &input]() { image = std::make_unique<Image>(input, ReadMode::Mapped); });
+    image.reset();
+    bench.Run(megapixels, "write buffered", width, height, file_size, nothing,
+              [&source, &output]() { source.Write(output, WriteMode::Buffered); });
+    bench.Run(megapixels, "write direct", width, height, file_size, nothing,
+              [&source, &output]() { source.Write(output, WriteMode::Direct); });
+    std::filesystem::remove(output);
+
+    for (const auto &chain: BenchChains(width, height)) {
+        auto filters = FilterFactory::CreateFilters(ToFilters(chain));
+        Image copy = source;
+        bench.Run(megapixels, chain, width, height, pixel_bytes, [&copy, &source]() { copy = source; },
+                  [&copy, &filters]() { FilterFactory::ApplyFilters(copy, filters); });
+    }
+    std::filesystem::remove(input);
+}
+
+}
+
+int main(int argc, const char *argv[]) {
+    try {
+        BenchOptions options = ParseOptions(argc, argv);
+        ThreadPool::Instance().SetThreads(options.threads);
+
+        Bench bench(options);
+        for (size_t megapixels: options.sizes) {
+            BenchSize(bench, megapixels);
+        }
+
+        if (options.output.empty()) {
+            bench.Print(std::cout);
+        } else {
+            std::ofstream out(options.output);
+            bench.Print(out);
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what();
+        return 1;
+    }
+    return 0;
+}
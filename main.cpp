@@ -1,12 +1,36 @@
-#include "FilterFactory.h"
+#include "Batch.h"
+#include "FilterPlan.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
 #include <iostream>
 
 int main(int argc, const char* argv[]) {
     try {
         auto parser_results = ImageParser::Parse(argc, argv);
-        Image image(parser_results.input_file_path);
-        FilterFactory::ApplyFilters(image, parser_results.filters);
-        image.Write(parser_results.output_file_path);
+        ThreadPool::Instance().SetThreads(parser_results.threads);
+        if (!parser_results.profile_file.empty()) {
+            Profiler::Instance().Start();
+        }
+        FilterPlan plan(parser_results.filters); // built once, even for a whole batch
+        if (parser_results.print_plan) {
+            std::cout << plan.Describe();
+        }
+        auto filters = plan.Filters();
+        auto compression = parser_results.compression == "rle8" ? Compression::Rle8 : Compression::None;
+        if (parser_results.IsBatch()) {
+            auto jobs = parser_results.batch_manifest.empty()
+                        ? BatchRunner::ListDirectory(parser_results.input_dir, parser_results.output_dir)
+                        : BatchRunner::ReadManifest(parser_results.batch_manifest);
+            BatchStats stats = BatchRunner(filters, parser_results.jobs, compression).Run(jobs, std::cerr);
+            std::cout << stats.Describe();
+        } else {
+            ProcessImage(filters, parser_results.input_file_path, parser_results.output_file_path, compression);
+        }
+        if (!parser_results.profile_file.empty()) {
+            Profiler::Instance().Stop();
+            std::cout << Profiler::Instance().Summary();
+            Profiler::Instance().WriteTrace(parser_results.profile_file);
+        }
     } catch (std::exception& e) {
         std::cerr << e.what();
     }
@@ -183,10 +183,15 @@ TEST_CASE("Parsing Possible Image-Changing Cases") {
 
         SECTION("Crystallize") {
 
-            const char* argv_not_1[] = {"./image_processor", "input", "output", "-crystal", "Java", "Ruby"};
+            const char* argv_not_1[] = {"./image_processor", "input", "output", "-crystal", "Java", "Ruby", "Go"};
 
-            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_not_1),
-                                "Crystallization filter has only 1 parameter: shard size\n");
+            REQUIRE_THROWS_WITH(ImageParser::Parse(7, argv_not_1),
+                                "Crystallization filter has shard size and an optional seed\n");
+
+            const char* argv_bad_seed[] = {"./image_processor", "input", "output", "-crystal", "37", "Ruby"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_bad_seed),
+                                "Crystallization seed must be a non-negative integer\n");
 
             const char* argv_not_int[] = {"./image_processor", "input", "output", "-crystal", "123.45"};
 
@@ -197,6 +202,138 @@ TEST_CASE("Parsing Possible Image-Changing Cases") {
 
             REQUIRE_NOTHROW(ImageParser::Parse(5, argv));
             REQUIRE(ImageParser::Parse(5, argv) == ParserResults{"input", "output", {{"-crystal", {"37"}}}});
+
+            const char* argv_seed[] = {"./image_processor,", "input", "output", "-crystal", "37", "2024"};
+
+            REQUIRE(ImageParser::Parse(6, argv_seed) ==
+                    ParserResults{"input", "output", {{"-crystal", {"37", "2024"}}}});
+        }
+
+        SECTION("Convolution") {
+
+            const char* argv_no_size[] = {"./image_processor", "input", "output", "-conv"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(4, argv_no_size),
+                                "Convolution filter needs the kernel size and its coefficients\n");
+
+            const char* argv_even[] = {"./image_processor", "input", "output", "-conv", "2", "1", "1", "1", "1"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(9, argv_even), "Convolution kernel size must be odd\n");
+
+            const char* argv_not_square[] = {"./image_processor", "input", "output", "-conv", "3", "1", "1"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(7, argv_not_square),
+                                "Convolution filter needs size * size coefficients\n");
+
+            const char* argv_not_float[] = {"./image_processor", "input", "output", "-conv", "1", "one"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_not_float),
+                                "Convolution coefficients must be float numbers\n");
+
+            const char* argv_too_large[] = {"./image_processor", "input", "output", "-conv", "1", "1000000"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_too_large), "Convolution coefficients are too large\n");
+
+            const char* argv_nan[] = {"./image_processor", "input", "output", "-conv", "1", "nan"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_nan), "Convolution coefficients are too large\n");
+
+            const char* argv_largest[] = {"./image_processor", "input", "output", "-conv", "1", "2000"};
+
+            REQUIRE_NOTHROW(ImageParser::Parse(6, argv_largest));
+
+            const char* argv[] = {"./image_processor", "input", "output", "-conv", "3", "0", "-1", "0",
+                                  "-1",                "5",     "-1",     "0",     "-.5", "0", "-gs"};
+
+            REQUIRE(ImageParser::Parse(15, argv) ==
+                    ParserResults{"input",
+                                  "output",
+                                  {{"-conv", {"3", "0", "-1", "0", "-1", "5", "-1", "0", "-.5", "0"}}, {"-gs", {}}}});
+        }
+
+        SECTION("Box Blur") {
+
+            const char* argv_not_1[] = {"./image_processor", "input", "output", "-box"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(4, argv_not_1), "Box filter has only 1 parameter: radius\n");
+
+            const char* argv_not_int[] = {"./image_processor", "input", "output", "-box", "2.5"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_not_int), "Box radius must be a non-negative integer\n");
+
+            const char* argv[] = {"./image_processor", "input", "output", "-box", "3"};
+
+            REQUIRE(ImageParser::Parse(5, argv) == ParserResults{"input", "output", {{"-box", {"3"}}}});
+        }
+
+        SECTION("Bilateral") {
+
+            const char* argv_not_2[] = {"./image_processor", "input", "output", "-bilateral", "3"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_not_2),
+                                "Bilateral filter has 2 parameters: sigma_s and sigma_r\n");
+
+            const char* argv_not_float[] = {"./image_processor", "input", "output", "-bilateral", "3", "r"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_not_float),
+                                "Bilateral filter parameters must be float numbers\n");
+
+            const char* argv_zero[] = {"./image_processor", "input", "output", "-bilateral", "3", "0"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_zero),
+                                "Bilateral sigma_s must be non-negative and sigma_r positive\n");
+
+            const char* argv_nan[] = {"./image_processor", "input", "output", "-bilateral", "nan", "10"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_nan),
+                                "Bilateral sigma_s must be non-negative and sigma_r positive\n");
+
+            for (const char* sigma: {"100.5", "1e30", "inf"}) {
+                const char* argv_large[] = {"./image_processor", "input", "output", "-bilateral", sigma, "10"};
+
+                REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_large), "Bilateral sigma_s must be at most 100\n");
+            }
+
+            const char* argv[] = {"./image_processor", "input", "output", "-bilateral", "4", "12.5"};
+
+            REQUIRE(ImageParser::Parse(6, argv) == ParserResults{"input", "output", {{"-bilateral", {"4", "12.5"}}}});
+        }
+
+        SECTION("Flips And Rotation") {
+
+            const char* argv_param[] = {"./image_processor", "input", "output", "-rot90", "2"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_param),
+                                "Flips, rotation and transpose don't have any parameters\n");
+
+            const char* argv[] = {"./image_processor", "input", "output", "-flipv", "-fliph", "-rot90", "-transpose"};
+
+            REQUIRE(ImageParser::Parse(7, argv) ==
+                    ParserResults{"input", "output", {{"-flipv", {}}, {"-fliph", {}}, {"-rot90", {}}, {"-transpose", {}}}});
+        }
+
+        SECTION("Resize") {
+
+            const char* argv_short[] = {"./image_processor", "input", "output", "-resize", "640"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_short),
+                                "Resize filter has width, height and an optional method\n");
+
+            const char* argv_zero[] = {"./image_processor", "input", "output", "-resize", "640", "0"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(6, argv_zero),
+                                "Resize width and height must be positive integers\n");
+
+            const char* argv_method[] = {"./image_processor", "input", "output", "-resize", "640", "480", "nearest"};
+
+            REQUIRE_THROWS_WITH(ImageParser::Parse(7, argv_method),
+                                "Resize method must be lanczos, bicubic or box\n");
+
+            const char* argv[] = {"./image_processor", "input", "output", "-resize", "640", "480", "-resize", "64", "48",
+                                  "box"};
+
+            REQUIRE(ImageParser::Parse(10, argv) ==
+                    ParserResults{"input", "output", {{"-resize", {"640", "480"}}, {"-resize", {"64", "48", "box"}}}});
         }
 
         SECTION("Invalid Filters") {
@@ -289,3 +426,98 @@ TEST_CASE("Parsing Possible Image-Changing Cases") {
     }
 }
 
+TEST_CASE("Parsing Options") {
+
+    SECTION("Threads") {
+        const char* argv[] = {"./image_processor", "--threads", "8", "input", "output", "-gs"};
+
+        ParserResults expected{"input", "output", {{"-gs", {}}}};
+        expected.threads = 8;
+        REQUIRE(ImageParser::Parse(6, argv) == expected);
+
+        const char* argv_end[] = {"./image_processor", "input", "output", "-blur", "1.5", "--threads", "2"};
+
+        expected = ParserResults{"input", "output", {{"-blur", {"1.5"}}}};
+        expected.threads = 2;
+        REQUIRE(ImageParser::Parse(7, argv_end) == expected);
+
+        const char* argv_no_value[] = {"./image_processor", "input", "output", "-gs", "--threads"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_no_value), "--threads option needs the number of threads\n");
+
+        const char* argv_not_int[] = {"./image_processor", "input", "output", "--threads", "many"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_not_int), "--threads option needs the number of threads\n");
+    }
+
+    SECTION("Plan") {
+        const char* argv[] = {"./image_processor", "input", "output", "-gs", "--plan"};
+
+        ParserResults expected{"input", "output", {{"-gs", {}}}};
+        expected.print_plan = true;
+        REQUIRE(ImageParser::Parse(5, argv) == expected);
+    }
+
+    SECTION("Batch") {
+        const char* argv[] = {"./image_processor", "--batch", "manifest.txt", "-gs", "-blur", "2", "--jobs", "4"};
+
+        ParserResults expected{"", "", {{"-gs", {}}, {"-blur", {"2"}}}};
+        expected.batch_manifest = "manifest.txt";
+        expected.jobs = 4;
+        REQUIRE(ImageParser::Parse(8, argv) == expected);
+
+        const char* argv_dir[] = {"./image_processor", "--input-dir", "in", "--output-dir", "out", "-neg"};
+
+        expected = ParserResults{"", "", {{"-neg", {}}}};
+        expected.input_dir = "in";
+        expected.output_dir = "out";
+        REQUIRE(ImageParser::Parse(6, argv_dir) == expected);
+
+        const char* argv_no_output[] = {"./image_processor", "--input-dir", "in", "-neg"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(4, argv_no_output),
+                            "--input-dir needs --output-dir for the filtered images\n");
+
+        const char* argv_both[] = {"./image_processor", "--batch", "m.txt", "--input-dir", "in", "--output-dir", "out"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(7, argv_both), "Choose either --batch or --input-dir\n");
+
+        const char* argv_no_manifest[] = {"./image_processor", "-gs", "--batch"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(3, argv_no_manifest), "--batch option needs the manifest file\n");
+
+        const char* argv_bad_filter[] = {"./image_processor", "--batch", "m.txt", "-gs", "1"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_bad_filter), "Grayscale filter doesn't have any parameters\n");
+    }
+
+    SECTION("Profile") {
+        const char* argv[] = {"./image_processor", "input", "output", "--profile", "trace.json", "-gs"};
+
+        ParserResults expected{"input", "output", {{"-gs", {}}}};
+        expected.profile_file = "trace.json";
+        REQUIRE(ImageParser::Parse(6, argv) == expected);
+
+        const char* argv_no_file[] = {"./image_processor", "input", "output", "-gs", "--profile"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_no_file), "--profile option needs the trace file\n");
+    }
+
+    SECTION("Compress") {
+        const char* argv[] = {"./image_processor", "input", "output", "--compress", "rle8", "-gs"};
+
+        ParserResults expected{"input", "output", {{"-gs", {}}}};
+        expected.compression = "rle8";
+        REQUIRE(ImageParser::Parse(6, argv) == expected);
+
+        const char* argv_rle4[] = {"./image_processor", "input", "output", "--compress", "rle4"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(5, argv_rle4), "The only supported compression method is rle8\n");
+    }
+
+    SECTION("Unknown Option") {
+        const char* argv[] = {"./image_processor", "input", "output", "--fast"};
+
+        REQUIRE_THROWS_WITH(ImageParser::Parse(4, argv), "Unknown option --fast\n");
+    }
+}
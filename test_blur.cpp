@@ -0,0 +1,203 @@
+#include "catch.hpp"
+#include "BandPipeline.h"
+#include "Filter.h"
+#include "FilterFactory.h"
+#include "PixelKernels.h"
+#include "ThreadPool.h"
+#include "test_images.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+namespace {
+
+// std::round(sum / window) for every possible sum of the window, the way the blur divided before
+std::vector<uint8_t> ExactMeans(size_t window) {
+    std::vector<uint8_t> means(255 * window + 1);
+    for (size_t sum = 0; sum < means.size(); ++sum) {
+        means[sum] = std::round(static_cast<double>(sum) / static_cast<double>(window));
+    }
+    return means;
+}
+
+std::vector<uint8_t> ScaledMeans(size_t window) {
+    std::vector<uint32_t> sums(255 * window + 1);
+    for (size_t sum = 0; sum < sums.size(); ++sum) {
+        sums[sum] = sum;
+    }
+    std::vector<uint8_t> means(sums.size());
+    ScaleSums(sums.data(), sums.size(), BoxReciprocal(window), means.data());
+    return means;
+}
+
+size_t MaxDifference(const std::vector<uint8_t> &first, const std::vector<uint8_t> &second) {
+    size_t difference = 0;
+    for (size_t index = 0; index < first.size(); ++index) {
+        difference = std::max<size_t>(difference, std::abs(first[index] - second[index]));
+    }
+    return difference;
+}
+
+// the blur passes computed the slow way: sums of clamped neighbours divided with std::round
+ImageBuffer ReferencePass(const ImageBuffer &source, size_t radius, bool vertical) {
+    ImageBuffer target(source.Height(), source.Width());
+    auto height = static_cast<ptrdiff_t>(source.Height());
+    auto width = static_cast<ptrdiff_t>(source.Width());
+    auto reach = static_cast<ptrdiff_t>(radius);
+    for (ptrdiff_t i = 0; i < height; ++i) {
+        for (ptrdiff_t j = 0; j < width; ++j) {
+            for (size_t channel = 0; channel < 3; ++channel) {
+                double sum = 0;
+                for (ptrdiff_t k = -reach; k <= reach; ++k) {
+                    ptrdiff_t row = vertical ? std::clamp<ptrdiff_t>(i + k, 0, height - 1) : i;
+                    ptrdiff_t column = vertical ? j : std::clamp<ptrdiff_t>(j + k, 0, width - 1);
+                    sum += reinterpret_cast<const uint8_t *>(source.Row(row))[column * 3 + channel];
+                }
+                reinterpret_cast<uint8_t *>(target.Row(i))[j * 3 + channel] = std::round(sum / (2 * radius + 1));
+            }
+        }
+    }
+    return target;
+}
+
+std::vector<char> FileBytes(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+}
+
+TEST_CASE("Box Blur Rounding") {
+
+    SECTION("Exact Up To kExactBoxWindow") {
+        for (size_t window = 1; window <= kExactBoxWindow; window += 2) {
+            REQUIRE(MaxDifference(ScaledMeans(window), ExactMeans(window)) == 0);
+        }
+    }
+
+    SECTION("Off By At Most One Below kMaxBoxWindow") {
+        for (size_t window: {257, 1001, 4097, 30001, 65791}) {
+            REQUIRE(MaxDifference(ScaledMeans(window), ExactMeans(window)) <= 1);
+        }
+    }
+}
+
+TEST_CASE("Box Blur Passes") {
+    std::mt19937 gen(14);
+    GaussianBlur blur(1);
+
+    SECTION("Small Windows Are Exact") {
+        for (size_t radius: {0, 1, 2, 5, 17, 127}) {
+            ImageBuffer source = RandomImage(gen() % 40 + 1, gen() % 40 + 1, gen);
+            ImageBuffer horizontal(source.Height(), source.Width());
+            ImageBuffer vertical(source.Height(), source.Width());
+            blur.HorizontalBlur(source, horizontal, radius);
+            blur.VerticalBlur(source, vertical, radius);
+
+            REQUIRE(MaxDifference(horizontal, ReferencePass(source, radius, false)) == 0);
+            REQUIRE(MaxDifference(vertical, ReferencePass(source, radius, true)) == 0);
+        }
+    }
+
+    SECTION("Large Windows Are Within One") {
+        ImageBuffer source = RandomImage(250, 300, gen);
+        ImageBuffer horizontal(source.Height(), source.Width());
+        ImageBuffer vertical(source.Height(), source.Width());
+        blur.HorizontalBlur(source, horizontal, 300);
+        blur.VerticalBlur(source, vertical, 300);
+
+        REQUIRE(MaxDifference(horizontal, ReferencePass(source, 300, false)) <= 1);
+        REQUIRE(MaxDifference(vertical, ReferencePass(source, 300, true)) <= 1);
+    }
+
+    SECTION("Rows Without Pixels") {
+        ImageBuffer source(5, 0);
+        ImageBuffer target(5, 0);
+        blur.HorizontalBlur(source, target, 2);
+        blur.VerticalBlur(source, target, 2);
+        REQUIRE(target.Width() == 0);
+    }
+
+    SECTION("Columns Without Pixels") {
+        ImageBuffer source(0, 5);
+        ImageBuffer target(0, 5);
+        blur.HorizontalBlur(source, target, 2);
+        blur.VerticalBlur(source, target, 2);
+        REQUIRE(target.Height() == 0);
+    }
+}
+
+TEST_CASE("Guided Filter") {
+    std::mt19937 gen(20);
+    auto apply = [](const ImageBuffer &pixels, float sigma_spatial, float sigma_range) {
+        Image image(BMPHeaders{}, pixels);
+        GuidedFilter(sigma_spatial, sigma_range).Apply(image);
+        return image.Pixels();
+    };
+
+    SECTION("Flat Images Stay Flat") {
+        ImageBuffer flat(37, 41);
+        std::fill(flat.Row(0), flat.Row(0) + 41, Pixel{37, 120, 250});
+        for (size_t i = 1; i < flat.Height(); ++i) {
+            std::copy_n(std::as_const(flat).Row(0), 41, flat.Row(i));
+        }
+        for (float sigma_spatial: {0.0f, 2.0f, 30.0f}) { // windows smaller and larger than the image
+            REQUIRE(MaxDifference(apply(flat, sigma_spatial, 10), flat) == 0);
+        }
+    }
+
+    SECTION("Step Edges Survive") {
+        ImageBuffer step(30, 40);
+        for (size_t i = 0; i < step.Height(); ++i) {
+            for (size_t j = 0; j < step.Width(); ++j) {
+                uint8_t value = j < 20 ? 40 : 200;
+                step.Row(i)[j] = Pixel{value, value, value};
+            }
+        }
+        ImageBuffer box = step;
+        Image image(BMPHeaders{}, box);
+        BoxFilter(4).Apply(image);
+
+        ImageBuffer guided = apply(step, 4, 10);
+        REQUIRE(MaxDifference(guided, step) <= 4);
+        REQUIRE(MaxDifference(image.Pixels(), step) > 60); // what plain smoothing does to it
+    }
+
+    SECTION("Mapped Pixels On Several Threads") {
+        ThreadPool::Instance().SetThreads(8);
+        ImageBuffer source = RandomImage(2000, 1000, gen); // large enough for copies on write to overlap
+        auto owner = std::make_shared<ImageBuffer>(source);
+        const uint8_t *data = std::as_const(*owner).Data();
+        ImageBuffer borrowed = ImageBuffer::Borrow(owner, data, source.Height(), source.Width(), owner->Stride());
+
+        ImageBuffer expected = apply(source, 3, 20);
+        REQUIRE(MaxDifference(apply(borrowed, 3, 20), expected) == 0);
+        ThreadPool::Instance().SetThreads(0);
+    }
+
+    SECTION("Streamed Output Equals The Whole Image") {
+        std::string input = std::filesystem::temp_directory_path() / "bmp_editor_guided.bmp";
+        std::string whole = std::filesystem::temp_directory_path() / "bmp_editor_guided_whole.bmp";
+        std::string streamed = std::filesystem::temp_directory_path() / "bmp_editor_guided_streamed.bmp";
+        BMPHeaders headers{};
+        headers.file_type = 0x4D42;
+        headers.DIBHeader_size = 40;
+        headers.color_planes = 1;
+        headers.bits_per_pixel = 24;
+        Image(headers, RandomImage(173, 61, gen)).Write(input);
+
+        std::vector<std::shared_ptr<Filter>> filters = {std::make_shared<GuidedFilter>(5.0f, 15.0f)};
+        Image image(input);
+        FilterFactory::ApplyFilters(image, filters);
+        image.Write(whole);
+        BandPipeline(filters, 16).Run(input, streamed);
+
+        REQUIRE(FileBytes(streamed) == FileBytes(whole));
+        std::filesystem::remove(input);
+        std::filesystem::remove(whole);
+        std::filesystem::remove(streamed);
+    }
+}
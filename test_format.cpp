@@ -0,0 +1,228 @@
+#include "catch.hpp"
+#include "BMPReader.h"
+#include "BMPWriter.h"
+#include "Image.h"
+#include "PixelKernels.h"
+#include "Rle.h"
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+
+namespace {
+
+std::vector<char> FileBytes(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+BMPHeaders MakeHeaders(size_t width, size_t height, uint16_t bits_per_pixel) {
+    BMPHeaders headers{};
+    headers.file_type = 0x4D42;
+    headers.DIBHeader_size = 40;
+    headers.width_ = width;
+    headers.height_ = height;
+    headers.color_planes = 1;
+    headers.bits_per_pixel = bits_per_pixel;
+    headers.colors_number = bits_per_pixel == 8 ? 256 : 0;
+    return headers;
+}
+
+// writes a random image in the format, reads it back in both modes and writes it again
+void RoundTrip(const BMPHeaders &headers, const std::vector<uint8_t> &extra, bool gray, std::mt19937 &gen,
+               Compression compression = Compression::None) {
+    BMPFormat format(headers, extra.data(), extra.size());
+    std::string path = std::filesystem::temp_directory_path() / "bmp_editor_format.bmp";
+    std::string copy = std::filesystem::temp_directory_path() / "bmp_editor_format_copy.bmp";
+    {
+        BMPWriter writer(path, headers, format);
+        std::vector<Pixel> row(headers.width_);
+        std::vector<uint8_t> alpha(headers.width_);
+        for (size_t i = 0; i < static_cast<size_t>(headers.height_); ++i) {
+            for (size_t j = 0; j < row.size(); ++j) {
+                uint8_t value = j > 0 && gen() % 4 > 0 ? row[j - 1].green : gen(); // runs to compress
+                row[j] = gray ? Pixel{value, value, value} : Pixel{value, uint8_t(gen()), uint8_t(gen())};
+                alpha[j] = gen();
+            }
+            writer.WriteRow(row.data(), alpha.data());
+        }
+        writer.Close();
+    }
+    for (ReadMode mode: {ReadMode::Mapped, ReadMode::Stream}) {
+        Image(path, mode).Write(copy, WriteMode::Buffered, compression);
+        REQUIRE(FileBytes(copy) == FileBytes(path));
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(copy);
+}
+
+}
+
+TEST_CASE("BMP Formats") {
+    std::mt19937 gen(21);
+
+    SECTION("BGRA Unpack And Pack") {
+        for (size_t count: {1, 5, 6, 7, 16, 33}) { // the scalar tails of the vector loops
+            std::vector<uint8_t> source(4 * count);
+            for (auto &byte: source) {
+                byte = gen();
+            }
+            std::vector<Pixel> row(count);
+            std::vector<uint8_t> alpha(count);
+            UnpackBGRA(source.data(), count, row.data(), alpha.data());
+            REQUIRE(row[count - 1].blue == source[4 * count - 2]);
+            REQUIRE(alpha[count - 1] == source[4 * count - 1]);
+
+            std::vector<uint8_t> packed(4 * count);
+            PackBGRA(row.data(), alpha.data(), count, packed.data());
+            REQUIRE(packed == source);
+            PackBGRA(row.data(), nullptr, count, packed.data());
+            REQUIRE(packed[4 * count - 1] == 255);
+        }
+    }
+
+    SECTION("32 Bits With Alpha") {
+        RoundTrip(MakeHeaders(37, 11, 32), {}, false, gen);
+    }
+
+    SECTION("32 Bits With A V4 Header") {
+        BMPHeaders headers = MakeHeaders(6, 5, 32);
+        headers.DIBHeader_size = 108;
+        headers.compression_method = 3;
+        std::vector<uint8_t> extra(68);
+        extra[2] = 0xFF; // red, green, blue and alpha masks
+        extra[5] = 0xFF;
+        extra[8] = 0xFF;
+        extra[15] = 0xFF;
+        RoundTrip(headers, extra, false, gen);
+
+        extra[2] = 0;
+        extra[0] = 0xFF;
+        REQUIRE_THROWS_WITH(BMPFormat(headers, extra.data(), extra.size()),
+                            "32-bit images must keep their channels in B, G, R, A order\n");
+    }
+
+    SECTION("8 Bits Gray") {
+        std::vector<uint8_t> palette;
+        for (size_t index = 0; index < 256; ++index) {
+            palette.insert(palette.end(), {uint8_t(index), uint8_t(index), uint8_t(index), 0});
+        }
+        BMPHeaders headers = MakeHeaders(13, 7, 8);
+        REQUIRE(BMPFormat(headers, palette.data(), palette.size()).IsGray());
+        RoundTrip(headers, palette, true, gen);
+
+        palette[4 * 7] = 1; // one color isn't gray, the image becomes 24-bit
+        BMPFormat colors(headers, palette.data(), palette.size());
+        REQUIRE(colors.Output().BitsPerPixel() == 24);
+    }
+
+    SECTION("RLE8 Decoding") {
+        // a run, a delta to the next row, a run, a literal run past the width with its padding and the end
+        std::vector<uint8_t> data = {3, 7, 0, 2, 1, 1, 2, 9, 0, 3, 1, 2, 4, 0, 0, 1};
+        RleDecoder decoder(8, 8);
+        std::vector<uint8_t> indices(8);
+        REQUIRE(decoder.DecodeRow(data.data(), 5, indices.data()) == std::nullopt); // the delta is cut
+        REQUIRE(decoder.DecodeRow(data.data(), data.size(), indices.data()) == 6);
+        REQUIRE(indices == std::vector<uint8_t>{7, 7, 7, 0, 0, 0, 0, 0});
+        REQUIRE(decoder.DecodeRow(data.data() + 6, 6, indices.data()) == std::nullopt); // the padding is cut
+        REQUIRE(decoder.DecodeRow(data.data() + 6, data.size() - 6, indices.data()) == 10);
+        REQUIRE(indices == std::vector<uint8_t>{0, 0, 0, 0, 9, 9, 1, 2});
+        REQUIRE(decoder.DecodeRow(nullptr, 0, indices.data()) == 0); // past the end of the image
+        REQUIRE(indices == std::vector<uint8_t>(8, 0));
+    }
+
+    SECTION("RLE4 Decoding") {
+        std::vector<uint8_t> data = {5, 0x12, 0, 3, 0x34, 0x50, 0, 0};
+        RleDecoder decoder(4, 9);
+        std::vector<uint8_t> indices(9);
+        REQUIRE(decoder.DecodeRow(data.data(), data.size(), indices.data()) == 8);
+        REQUIRE(indices == std::vector<uint8_t>{1, 2, 1, 2, 1, 3, 4, 5, 0});
+    }
+
+    SECTION("RLE8 Encoding") {
+        for (size_t width: {1, 2, 3, 7, 300, 1000}) {
+            std::vector<uint8_t> values(width);
+            for (size_t j = 0; j < width; ++j) {
+                values[j] = j > 0 && gen() % 2 == 0 ? values[j - 1] : gen() % 4;
+            }
+            std::vector<uint8_t> encoded(MaxRle8Row(width));
+            size_t size = EncodeRle8Row(values.data(), width, 1, encoded.data());
+            REQUIRE(size <= encoded.size());
+            REQUIRE(size % 2 == 0);
+
+            std::vector<uint8_t> decoded(width);
+            REQUIRE(RleDecoder(8, width).DecodeRow(encoded.data(), size, decoded.data()) == size);
+            REQUIRE(decoded == values);
+        }
+    }
+
+    SECTION("8 Bits Gray Compressed") {
+        std::vector<uint8_t> palette;
+        for (size_t index = 0; index < 256; ++index) {
+            palette.insert(palette.end(), {uint8_t(index), uint8_t(index), uint8_t(index), 0});
+        }
+        BMPHeaders headers = MakeHeaders(301, 9, 8);
+        headers.compression_method = 1;
+        RoundTrip(headers, palette, true, gen, Compression::Rle8);
+
+        BMPFormat colors(MakeHeaders(4, 4, 24), nullptr, 0); // only 8-bit outputs are compressed
+        REQUIRE(!colors.Output(Compression::Rle8).IsCompressed());
+    }
+
+    SECTION("Top-Down Files") {
+        std::string path = std::filesystem::temp_directory_path() / "bmp_editor_bottom_up.bmp";
+        std::string top_down = std::filesystem::temp_directory_path() / "bmp_editor_top_down.bmp";
+        std::string copy = std::filesystem::temp_directory_path() / "bmp_editor_top_down_copy.bmp";
+        for (uint16_t bits: {24, 32}) {
+            BMPHeaders headers = MakeHeaders(5, 4, bits);
+            {
+                BMPWriter writer(path, headers, BMPFormat(headers, nullptr, 0));
+                std::vector<Pixel> row(5);
+                for (size_t i = 0; i < 4; ++i) {
+                    for (auto &pixel: row) {
+                        pixel = Pixel{uint8_t(gen()), uint8_t(gen()), uint8_t(gen())};
+                    }
+                    writer.WriteRow(row.data());
+                }
+                writer.Close();
+            }
+            std::vector<char> bytes = FileBytes(path);
+            std::vector<char> reversed = bytes;
+            size_t stride = 5 * bits / 8 + (bits == 24 ? 1 : 0);
+            for (size_t i = 0; i < 4; ++i) { // the same rows in the other order, with a negative height
+                std::copy_n(bytes.end() - (i + 1) * stride, stride, reversed.end() - (4 - i) * stride);
+            }
+            int32_t height = -4;
+            std::memcpy(reversed.data() + sizeof(BitmapFileHeader) + offsetof(DIBHeader, height_), &height,
+                        sizeof(height));
+            std::ofstream(top_down, std::ios::binary).write(reversed.data(), reversed.size());
+
+            for (ReadMode mode: {ReadMode::Mapped, ReadMode::Stream}) { // written bottom-up
+                Image image(top_down, mode);
+                REQUIRE(image.Height() == 4);
+                image.Write(copy);
+                REQUIRE(FileBytes(copy) == bytes);
+            }
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(top_down);
+        std::filesystem::remove(copy);
+    }
+
+    SECTION("Images 0 Pixels Wide") { // valid files whose rows take no bytes
+        for (uint16_t bits: {24, 32}) {
+            RoundTrip(MakeHeaders(0, 7, bits), {}, false, gen);
+        }
+    }
+
+    SECTION("Heights Without A Positive Value") {
+        BMPHeaders headers = MakeHeaders(5, 4, 24);
+        headers.height_ = std::numeric_limits<int32_t>::min();
+        REQUIRE_THROWS_WITH(CheckHeaders(headers), "The height of the image is out of range\n");
+        headers.height_ = std::numeric_limits<int32_t>::min() + 1;
+        REQUIRE_NOTHROW(CheckHeaders(headers));
+    }
+}
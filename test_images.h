@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+
+// an image of random bytes, for the tests that compare kernels and buffers
+inline ImageBuffer RandomImage(size_t height, size_t width, std::mt19937 &gen) {
+    ImageBuffer image(height, width);
+    for (size_t i = 0; i < height; ++i) {
+        auto *row = reinterpret_cast<uint8_t *>(image.Row(i));
+        for (size_t x = 0; x < width * 3; ++x) {
+            row[x] = gen();
+        }
+    }
+    return image;
+}
+
+// the largest difference of two channel values at the same place, the buffers are of the same size
+inline size_t MaxDifference(const ImageBuffer &first, const ImageBuffer &second) {
+    size_t difference = 0;
+    for (size_t i = 0; i < first.Height(); ++i) {
+        const auto *first_row = reinterpret_cast<const uint8_t *>(first.Row(i));
+        const auto *second_row = reinterpret_cast<const uint8_t *>(second.Row(i));
+        for (size_t x = 0; x < first.Width() * 3; ++x) {
+            difference = std::max<size_t>(difference, std::abs(first_row[x] - second_row[x]));
+        }
+    }
+    return difference;
+}
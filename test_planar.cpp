@@ -0,0 +1,251 @@
+#include "catch.hpp"
+#include "FilterFactory.h"
+#include "Orientation.h"
+#include "PixelKernels.h"
+#include "PlanarBuffer.h"
+#include "Profiler.h"
+#include "ScratchArena.h"
+#include "test_images.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+bool SamePixels(const ImageBuffer &first, const ImageBuffer &second) {
+    for (size_t i = 0; i < first.Height(); ++i) {
+        for (size_t j = 0; j < first.Width(); ++j) {
+            const Pixel &a = first.Row(i)[j];
+            const Pixel &b = second.Row(i)[j];
+            if (a.red != b.red || a.green != b.green || a.blue != b.blue) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+TEST_CASE("Planar Pixels") {
+    std::mt19937 gen(19);
+
+    SECTION("Split And Merge Round Trip") {
+        for (size_t width: {1, 7, 15, 16, 33, 64, 101}) { // the tails of every vector width
+            ImageBuffer source = RandomImage(gen() % 20 + 1, width, gen);
+            PlanarBuffer planes = PlanarBuffer::Split(source);
+
+            REQUIRE(planes.Height() == source.Height());
+            REQUIRE(planes.Width() == source.Width());
+            REQUIRE(planes.Row(0, 0)[0] == source.Row(0)[0].red);
+            REQUIRE(planes.Row(2, 0)[width - 1] == source.Row(0)[width - 1].blue);
+            REQUIRE(SamePixels(planes.Merge(), source));
+        }
+    }
+
+    SECTION("Grayscale Matches The Interleaved One") {
+        for (size_t width: {1, 15, 16, 31, 32, 100, 257}) {
+            ImageBuffer source = RandomImage(1, width, gen);
+            std::vector<uint8_t> red(width), green(width), blue(width);
+            SplitRow(source.Row(0), width, red.data(), green.data(), blue.data());
+            GrayscalePlanes(red.data(), green.data(), blue.data(), width);
+            GrayscaleRow(source.Row(0), width);
+
+            ImageBuffer planar(1, width);
+            MergeRow(red.data(), green.data(), blue.data(), width, planar.Row(0));
+            REQUIRE(SamePixels(planar, source));
+        }
+    }
+
+    SECTION("Grays Keep Their Level") {
+        const size_t width = 53; // 32 pixels for AVX2, 16 for SSSE3 and 5 for the scalar tail
+        for (int level = 0; level < 256; ++level) {
+            auto value = static_cast<uint8_t>(level);
+            ImageBuffer row(1, width);
+            std::fill(row.Row(0), row.Row(0) + width, Pixel{value, value, value});
+            std::vector<uint8_t> red(width, value), green(width, value), blue(width, value);
+            GrayscaleRow(row.Row(0), width);
+            GrayscalePlanes(red.data(), green.data(), blue.data(), width);
+
+            for (size_t j = 0; j < width; ++j) {
+                const Pixel &pixel = row.Row(0)[j];
+                REQUIRE((pixel.red == value && pixel.green == value && pixel.blue == value));
+                REQUIRE((red[j] == value && green[j] == value && blue[j] == value));
+            }
+        }
+    }
+
+    SECTION("Views Share The Pixels") {
+        ImageBuffer source = RandomImage(9, 13, gen);
+        ImageBuffer copy = source;
+        const Pixel *row = source.Row(3);
+        ImageBuffer view = std::move(source).View(3, 0, 4, 5);
+
+        REQUIRE(view.Height() == 4);
+        REQUIRE(view.Width() == 5);
+        REQUIRE(view.IsView());
+        REQUIRE(view.Row(0) == row); // nothing was copied
+        REQUIRE(SamePixels(view, std::move(copy).View(3, 0, 4, 5)));
+
+        ImageBuffer compact = view; // copies take only the rows and pixels they see
+        REQUIRE(!compact.IsView());
+        REQUIRE(compact.Stride() == 16);
+        REQUIRE(SamePixels(compact, view));
+
+        PlanarBuffer planes = PlanarBuffer::Split(RandomImage(9, 13, gen));
+        uint8_t value = planes.Row(2, 5)[1];
+        PlanarBuffer planes_view = std::move(planes).View(4, 0, 2, 3);
+        REQUIRE(planes_view.Height() == 2);
+        REQUIRE(planes_view.Row(2, 1)[1] == value);
+    }
+
+    SECTION("Moved-From Planes Are Empty") {
+        PlanarBuffer planes = PlanarBuffer::Split(RandomImage(9, 13, gen));
+        uint8_t value = planes.Row(1, 6)[2];
+        PlanarBuffer view = std::move(planes).View(1, 2, 7, 5);
+        REQUIRE((planes.Empty() && planes.Height() == 0 && planes.Width() == 0 && planes.Channels() == 0));
+
+        PlanarBuffer target(3, 4);
+        target = std::move(view);
+        REQUIRE((view.Empty() && view.Height() == 0 && view.Width() == 0 && view.Channels() == 0));
+        REQUIRE(target.Height() == 7);
+        REQUIRE(target.Width() == 5);
+        REQUIRE(target.Row(1, 5)[0] == value);
+    }
+
+    SECTION("Copies Into Allocations Of The Same Size") {
+        ImageBuffer source(4, 3); // rows of 9 bytes padded to 12
+        ImageBuffer target(6, 2); // rows of 6 bytes padded to 8, 48 bytes either way
+        const uint8_t *data = std::as_const(target).Data();
+        for (size_t i = 0; i < source.Height(); ++i) {
+            auto *row = reinterpret_cast<uint8_t *>(source.Row(i));
+            for (size_t x = 0; x < 9; ++x) {
+                row[x] = static_cast<uint8_t>(i * 10 + x);
+            }
+        }
+        target = source;
+
+        REQUIRE(std::as_const(target).Data() == data); // the allocation was reused
+        REQUIRE(target.Stride() == 12);
+        REQUIRE(SamePixels(target, source));
+    }
+
+    SECTION("Top-Down Rows") {
+        ImageBuffer source = RandomImage(6, 7, gen);
+        auto owner = std::make_shared<ImageBuffer>(source);
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(std::as_const(*owner).Row(0));
+        ImageBuffer top_down = ImageBuffer::Borrow(owner, data, 6, 7, owner->Stride(), RowOrder::TopDown);
+
+        REQUIRE(std::as_const(top_down).Row(0) == std::as_const(*owner).Row(5)); // the rows stay where they are
+        top_down.MakeWritable(); // the copy is bottom-up
+        REQUIRE(!top_down.IsView());
+        for (size_t i = 0; i < 6; ++i) {
+            REQUIRE(std::equal(top_down.Row(i), top_down.Row(i) + 7, source.Row(5 - i),
+                               [](const Pixel &a, const Pixel &b) { return a.red == b.red && a.blue == b.blue; }));
+        }
+    }
+
+    SECTION("Orientations Compose") {
+        auto same = [](const Orientation &a, const Orientation &b) {
+            return a.transposed == b.transposed && a.rows_flipped == b.rows_flipped &&
+                   a.columns_flipped == b.columns_flipped;
+        };
+        Orientation rotation = Orientation::Rotate90();
+        REQUIRE(rotation.Then(rotation).Then(rotation).Then(rotation).IsIdentity());
+        REQUIRE(Orientation::Transpose().Then(Orientation::Transpose()).IsIdentity());
+        REQUIRE(same(Orientation::Transpose().Then(Orientation::FlipHorizontally()), rotation));
+        REQUIRE(same(rotation.Then(rotation), Orientation::FlipVertically().Then(Orientation::FlipHorizontally())));
+    }
+
+    SECTION("Orient Moves Every Pixel") {
+        for (size_t code = 0; code < 8; ++code) {
+            Orientation orientation{(code & 1) != 0, (code & 2) != 0, (code & 4) != 0};
+            size_t height = gen() % 70 + 1;
+            size_t width = gen() % 70 + 1;
+            ImageBuffer source = RandomImage(height, width, gen);
+            PlanarBuffer planes = PlanarBuffer::Split(source);
+            ImageBuffer oriented = Orient(source, orientation);
+            PlanarBuffer oriented_planes = Orient(planes, orientation);
+
+            size_t target_height = orientation.transposed ? width : height;
+            size_t target_width = orientation.transposed ? height : width;
+            REQUIRE(oriented.Height() == target_height);
+            REQUIRE(oriented.Width() == target_width);
+            bool all_moved = true;
+            for (size_t i = 0; i < target_height; ++i) {
+                for (size_t j = 0; j < target_width; ++j) {
+                    size_t row = orientation.transposed ? j : i;
+                    size_t column = orientation.transposed ? i : j;
+                    row = orientation.rows_flipped ? height - 1 - row : row;
+                    column = orientation.columns_flipped ? width - 1 - column : column;
+                    const Pixel &expected = std::as_const(source).Row(row)[column];
+                    all_moved = all_moved && std::as_const(oriented).Row(i)[j].blue == expected.blue &&
+                                oriented_planes.Row(0, i)[j] == expected.red;
+                }
+            }
+            REQUIRE(all_moved);
+        }
+    }
+}
+
+TEST_CASE("Scratch Arena") {
+    std::mt19937 gen(18);
+    ScratchArena &arena = ScratchArena::Instance();
+    arena.Clear();
+
+    SECTION("Smaller Buffers Reuse Larger Allocations") {
+        ImageBuffer large(20, 30);
+        const uint8_t *data = std::as_const(large).Data();
+        arena.Release(std::move(large));
+        ImageBuffer small = arena.Acquire(10, 7); // 21 bytes of pixels in rows of 24
+        REQUIRE(std::as_const(small).Data() == data);
+        REQUIRE(small.Height() == 10);
+        REQUIRE(small.Width() == 7);
+        REQUIRE(small.Stride() == 24);
+        REQUIRE(arena.IdleBytes() == 0);
+        for (size_t i = 0; i < small.Height(); ++i) {
+            const uint8_t *row = reinterpret_cast<const uint8_t *>(std::as_const(small).Row(i));
+            REQUIRE((row[21] == 0 && row[22] == 0 && row[23] == 0));
+        }
+    }
+
+    SECTION("Idle Buffers Are Capped By Bytes") {
+        const size_t height = 1 << 15;
+        const size_t width = 4096; // rows without padding, so the pages are never touched
+        for (size_t i = 0; i < 3; ++i) {
+            arena.Release(ImageBuffer(height, width));
+        }
+        REQUIRE(arena.IdleBytes() == 2 * height * width * sizeof(Pixel));
+        REQUIRE(arena.IdleBytes() <= ScratchArena::kMaxIdleBytes);
+    }
+
+    SECTION("Nothing Is Allocated After Warm-Up") {
+        std::vector<std::shared_ptr<Filter>> filters = {std::make_shared<GaussianBlur>(2.0f),
+                                                        std::make_shared<Sharpening>(),
+                                                        std::make_shared<Crop>(70, 50)};
+        ImageBuffer source = RandomImage(90, 110, gen);
+        Profiler &profiler = Profiler::Instance();
+        profiler.Start();
+        for (const char *name: {"first", "second"}) {
+            ProfileScope scope("filter", name);
+            ImageBuffer pixels = arena.Acquire(source.Height(), source.Width());
+            for (size_t i = 0; i < source.Height(); ++i) {
+                std::copy_n(std::as_const(source).Row(i), source.Width(), pixels.Row(i));
+            }
+            Image image(BMPHeaders{}, std::move(pixels));
+            FilterFactory::ApplyFilters(image, filters);
+        }
+        profiler.Stop();
+
+        std::vector<ProfileRecord> records = profiler.Records();
+        auto run = [&records](const std::string &name) {
+            return *std::find_if(records.begin(), records.end(),
+                                 [&name](const ProfileRecord &record) { return record.name == name; });
+        };
+        REQUIRE(run("first").allocations > 0);
+        REQUIRE(run("second").allocations == 0);
+    }
+    arena.Clear();
+}
@@ -0,0 +1,134 @@
+#include "catch.hpp"
+#include "PixelKernels.h"
+#include "Resample.h"
+#include "test_images.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+TEST_CASE("Resampling") {
+    std::mt19937 gen(25);
+
+    SECTION("Weights Add Up To One") {
+        for (auto method: {ResampleMethod::Lanczos, ResampleMethod::Bicubic, ResampleMethod::Box}) {
+            for (auto [source, target]: {std::pair<size_t, size_t>{1, 7}, {7, 1}, {211, 333}, {333, 211}, {3001, 17}}) {
+                ResampleWeights weights = MakeResampleWeights(source, target, method);
+                REQUIRE(weights.first.size() == target);
+                for (size_t i = 0; i < target; ++i) {
+                    REQUIRE(weights.first[i] + weights.taps <= source);
+                    int sum = 0;
+                    for (size_t k = 0; k < weights.taps; ++k) {
+                        sum += weights.weights[i * weights.taps + k];
+                    }
+                    REQUIRE(sum == 1 << kResampleShift);
+                }
+            }
+        }
+    }
+
+    SECTION("Kernels Are Plain Weighted Sums") { // whatever version the CPU runs, tails included
+        std::vector<uint8_t> bytes(9 * 77);
+        std::generate(bytes.begin(), bytes.end(), gen);
+        std::vector<int16_t> weights(9 * 25);
+        std::generate(weights.begin(), weights.end(), [&gen] { return static_cast<int16_t>(gen() % 12000) - 4000; });
+        auto clamped = [](int sum) {
+            return std::clamp((sum + (1 << (kResampleShift - 1))) >> kResampleShift, 0, 255);
+        };
+
+        for (size_t taps: {1, 2, 5, 9}) {
+            const uint8_t *rows[9];
+            for (size_t k = 0; k < taps; ++k) {
+                rows[k] = bytes.data() + 77 * k;
+            }
+            std::vector<uint8_t> out(77);
+            ResampleColumns(rows, weights.data(), taps, out.size(), out.data());
+            for (size_t x = 0; x < out.size(); ++x) {
+                int sum = 0;
+                for (size_t k = 0; k < taps; ++k) {
+                    sum += weights[k] * rows[k][x];
+                }
+                REQUIRE(out[x] == clamped(sum));
+            }
+
+            for (size_t channels: {1, 3}) {
+                size_t count = 25;
+                std::vector<uint32_t> first(count);
+                std::generate(first.begin(), first.end(), [&] { return gen() % (bytes.size() / channels - taps + 1); });
+                std::vector<uint8_t> pixels(count * channels);
+                ResampleRow(bytes.data(), channels, first.data(), weights.data(), taps, count, pixels.data());
+                for (size_t i = 0; i < count; ++i) {
+                    for (size_t channel = 0; channel < channels; ++channel) {
+                        int sum = 0;
+                        for (size_t k = 0; k < taps; ++k) {
+                            sum += weights[i * taps + k] * bytes[(first[i] + k) * channels + channel];
+                        }
+                        REQUIRE(pixels[i * channels + channel] == clamped(sum));
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("Flat Images Stay Flat") {
+        ImageBuffer source(45, 61);
+        for (size_t i = 0; i < source.Height(); ++i) {
+            std::fill(source.Row(i), source.Row(i) + source.Width(), Pixel{200, 13, 97});
+        }
+        for (auto method: {ResampleMethod::Lanczos, ResampleMethod::Bicubic, ResampleMethod::Box}) {
+            for (auto [height, width]: {std::pair<size_t, size_t>{45, 200}, {101, 13}, {7, 7}}) {
+                ImageBuffer target = Resample(source, height, width, method);
+                REQUIRE(target.Height() == height);
+                REQUIRE(target.Width() == width);
+                for (size_t i = 0; i < height; ++i) {
+                    REQUIRE(std::all_of(target.Row(i), target.Row(i) + width,
+                                        [](const Pixel &pixel) {
+                                            return pixel.red == 200 && pixel.green == 13 && pixel.blue == 97;
+                                        }));
+                }
+            }
+        }
+    }
+
+    SECTION("Box By Whole Factors Is A Block Mean") {
+        ImageBuffer source = RandomImage(27, 36, gen);
+        ImageBuffer target = Resample(source, 9, 12, ResampleMethod::Box);
+        ImageBuffer means(9, 12);
+        for (size_t i = 0; i < 9; ++i) {
+            for (size_t x = 0; x < 12 * 3; ++x) {
+                double sum = 0;
+                for (size_t row = 3 * i; row < 3 * i + 3; ++row) {
+                    for (size_t column = 3 * (x / 3); column < 3 * (x / 3) + 3; ++column) {
+                        sum += reinterpret_cast<const uint8_t *>(source.Row(row))[column * 3 + x % 3];
+                    }
+                }
+                reinterpret_cast<uint8_t *>(means.Row(i))[x] = std::round(sum / 9);
+            }
+        }
+        REQUIRE(MaxDifference(target, means) == 0);
+    }
+
+    SECTION("Planes Match Interleaved Pixels") {
+        ImageBuffer source = RandomImage(33, 50, gen);
+        ImageBuffer pixels = Resample(source, 70, 21, ResampleMethod::Lanczos);
+        ImageBuffer planes = Resample(PlanarBuffer::Split(source), 70, 21, ResampleMethod::Lanczos).Merge();
+        REQUIRE(MaxDifference(pixels, planes) == 0);
+    }
+
+    SECTION("Empty Sources Give Black Images") {
+        ImageBuffer black(5, 5);
+        std::fill(black.Row(0), black.Row(0) + 5, Pixel{0, 0, 0});
+        for (size_t i = 1; i < black.Height(); ++i) {
+            std::copy_n(std::as_const(black).Row(0), 5, black.Row(i));
+        }
+        for (auto method: {ResampleMethod::Lanczos, ResampleMethod::Bicubic, ResampleMethod::Box}) {
+            for (auto [height, width]: {std::pair<size_t, size_t>{10, 0}, {0, 10}, {0, 0}}) {
+                ImageBuffer resized = Resample(ImageBuffer(height, width), 5, 5, method);
+                REQUIRE(resized.Height() == 5);
+                REQUIRE(resized.Width() == 5);
+                REQUIRE(MaxDifference(resized, black) == 0);
+            }
+        }
+    }
+}